@@ -6,15 +6,47 @@
 #include "toml++/impl/table.hpp"
 #include "toml++/toml.hpp"
 #include <algorithm> // Added this for std::find
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <curl/curl.h>
 #include <exception>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <linux/fs.h>
 #include <map>
+#include <mutex>
+#include <netdb.h>
+#include <numeric>
 #include <optional>
+#include <poll.h>
+#include <ranges>
+#include <semaphore>
+#include <set>
+#include <spawn.h>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
+#include <zlib.h>
 
 struct Dependency {
     std::string name;
@@ -26,7 +58,60 @@ struct DepIndex {
     std::string git;
     std::vector<std::string> aliases;
     std::optional<std::string> branch;
+    std::optional<std::string> rev; // Pinned commit, wins over `branch`
     bool header_only = false;
+    // A release .tar.gz instead of (or as well as) the git repo
+    std::optional<std::string> archive;
+    std::optional<std::string> sha256; // Of the archive, required with it
+    uint32_t strip = 1; // Leading path components to drop from its entries
+    std::vector<std::string> dependencies; // Other entries it needs synced
+};
+
+// Dep names end up in paths (build/deps/<name>, the store, the index cache),
+// so they're one plain path component: letters, digits and _.+-
+bool valid_dep_name(std::string_view name) {
+    return !name.empty() && name != "." && name != ".." &&
+           std::all_of(name.begin(), name.end(), [](unsigned char c) {
+               return std::isalnum(c) ||
+                      std::string_view("_.+-").find(c) != std::string_view::npos;
+           });
+}
+
+// Index and lock values (URLs, revs, branches) are passed to git as
+// arguments, where anything starting with '-' would be taken as an option
+bool option_like(std::string_view value) { return value.starts_with('-'); }
+
+// A [profiles.<name>] table. Anything left unset comes from the profile it
+// inherits (the built-in one of the same name, or `debug`).
+struct ProfileConfig {
+    std::optional<std::string> inherits;
+    std::optional<std::string> opt_level;  // "0", "2", "s", ...
+    std::optional<bool> debug_info;        // -g
+    std::optional<std::string> lto;        // "off", "thin" or "full"
+    std::optional<std::string> output_dir; // Objects go in <output_dir>/obj
+    std::optional<std::vector<std::string>> flags;      // Extra compile flags
+    std::optional<std::vector<std::string>> link_flags; // Extra link flags
+    std::optional<std::string> pgo_train; // Training command for --pgo
+    std::optional<int64_t> unity;         // Unity batch size, 0 for off
+    std::optional<std::string> linker;    // See Profile::linker
+    std::optional<bool> split_debug;      // -gsplit-dwarf + --gdb-index
+};
+
+// What a build actually uses, once inheritance is resolved
+struct Profile {
+    std::string name = "debug";
+    std::string opt_level = "0";
+    bool debug_info = true;
+    std::string lto = "off";
+    std::string output_dir = "build";
+    std::vector<std::string> flags = {};
+    std::vector<std::string> link_flags = {};
+    std::string pgo_train = "";
+    unsigned unity = 0;
+    // "auto" (fastest installed), "default" (the compiler's), mold, lld,
+    // gold or bfd. Empty until resolved, so dreamcpp.toml's can fill it in.
+    std::string linker = "";
+    bool split_debug = false;
 };
 
 struct AppConfig {
@@ -36,6 +121,8 @@ struct AppConfig {
     std::string standard = "c++20";
     std::string preferred_compiler = "clang++";
     std::vector<Dependency> deps = {};
+    std::map<std::string, ProfileConfig> profiles = {};
+    std::optional<std::string> linker; // For profiles that don't pick one
 };
 
 template <typename Container>
@@ -47,6 +134,188 @@ std::string join(const Container &container, const std::string &delimiter) {
     return result;
 }
 
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+uint64_t fnv1a(std::string_view data, uint64_t hash = FNV_OFFSET) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Plain SHA-256, used wherever a hash ends up shared between projects or
+// machines (compile cache keys, archive checksums) and FNV isn't enough
+class Sha256 {
+  public:
+    Sha256 &update(std::string_view data) {
+        for (unsigned char c : data) {
+            block[block_len++] = c;
+            if (block_len == 64) {
+                compress();
+                block_len = 0;
+            }
+        }
+        total_len += data.size();
+        return *this;
+    }
+
+    std::string hex() {
+        uint64_t bit_len = total_len * 8;
+        update(std::string_view("\x80", 1));
+        while (block_len != 56) {
+            update(std::string_view("\0", 1));
+        }
+        for (int i = 7; i >= 0; --i) {
+            block[block_len++] = (unsigned char)(bit_len >> (i * 8));
+        }
+        compress();
+
+        std::string result;
+        for (uint32_t word : state) {
+            result += std::format("{:08x}", word);
+        }
+        return result;
+    }
+
+  private:
+    std::array<uint32_t, 8> state = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                     0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                     0x1f83d9ab, 0x5be0cd19};
+    std::array<unsigned char, 64> block{};
+    size_t block_len = 0;
+    uint64_t total_len = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress() {
+        static constexpr std::array<uint32_t, 64> k = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+            0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+            0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+            0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+            0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+            0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+            0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+            0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+            0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+            0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+            0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        std::array<uint32_t, 64> w;
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t)block[i * 4] << 24 |
+                   (uint32_t)block[i * 4 + 1] << 16 |
+                   (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 =
+                rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 =
+                rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto [a, b, c, d, e, f, g, h] = state;
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + k[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+};
+
+// Streams a file through SHA-256 without loading it all at once
+std::optional<std::string> sha256_file(const std::string &fp) {
+    std::ifstream file(fp, std::ios::binary);
+    if (!file.is_open())
+        return std::nullopt;
+    Sha256 hasher;
+    std::array<char, 64 * 1024> buffer;
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hasher.update(std::string_view(buffer.data(), file.gcount()));
+    }
+    return hasher.hex();
+}
+
+// Leaves the mtime alone when nothing changed, so generated sources don't
+// look stale to the build graph
+bool write_if_changed(const std::filesystem::path &fp,
+                      const std::string &content) {
+    std::ifstream in(fp, std::ios::binary);
+    std::string existing((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+    if (in.is_open() && existing == content)
+        return true;
+    in.close();
+    std::ofstream out(fp, std::ios::binary);
+    out << content;
+    return out.good();
+}
+
+// Lists the member projects of a workspace, see namespace workspace
+const std::string WORKSPACE_MANIFEST = "dreamcpp.workspace.toml";
+
+std::filesystem::path dreamcpp_home() {
+    const char *home = getenv("HOME");
+    return std::filesystem::path(home ? home : "~") / ".dreamcpp";
+}
+
+// Deps materialized from the store have no .git, just this with the commit
+// (or the archive's hash) they're at
+const std::string REVISION_STAMP = ".dreamcpp-revision";
+
+// Reads the checked out commit straight out of .git, so no git process is
+// needed just to find out nothing changed
+std::string git_head_revision(const std::filesystem::path &repo) {
+    std::ifstream head(repo / ".git" / "HEAD");
+    std::string line;
+    if (!head.is_open()) {
+        std::ifstream stamp(repo / REVISION_STAMP);
+        std::getline(stamp, line);
+        return line;
+    }
+    if (!std::getline(head, line))
+        return "";
+    if (!line.starts_with("ref: "))
+        return line; // Detached HEAD
+
+    auto ref = line.substr(5);
+    std::ifstream ref_file(repo / ".git" / ref);
+    std::string revision;
+    if (std::getline(ref_file, revision))
+        return revision;
+
+    std::ifstream packed(repo / ".git" / "packed-refs");
+    while (std::getline(packed, line)) {
+        if (line.size() > 41 && line.substr(41) == ref)
+            return line.substr(0, 40);
+    }
+    return "";
+}
+
 template <typename Map, typename Key>
 std::optional<typename Map::mapped_type> get_or_nullopt(const Map &map,
                                                         const Key &key) {
@@ -64,36 +333,219 @@ void maybe_assign(const toml::table &tbl, const std::string &key, T &target) {
     }
 }
 
+std::string json_escape(std::string_view str) {
+    std::string out;
+    for (unsigned char c : str) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (c < 0x20)
+                out += std::format("\\u{:04x}", c);
+            else
+                out += (char)c;
+        }
+    }
+    return out;
+}
+
+// Timestamped spans for --trace (Chrome trace / Perfetto JSON) and the
+// phase summary printed with -v. Recording is off unless one of them asked.
+namespace trace {
+struct Span {
+    std::string name;
+    std::string category;
+    int64_t start_us;
+    int64_t duration_us;
+    uint32_t thread;
+    std::string detail;
+};
+
+std::atomic<bool> recording = false;
+std::mutex spans_mutex;
+std::vector<Span> spans;
+const auto origin = std::chrono::steady_clock::now();
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+}
+
+uint32_t thread_number() {
+    static std::atomic<uint32_t> next = 1;
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+void record(std::string name, std::string category, int64_t start_us,
+            std::string detail = "") {
+    if (!recording)
+        return;
+    Span span{std::move(name), std::move(category), start_us,
+              now_us() - start_us, thread_number(), std::move(detail)};
+    std::lock_guard lock(spans_mutex);
+    spans.push_back(std::move(span));
+}
+
+// Records a span covering its own lifetime
+class Scope {
+  public:
+    Scope(std::string name, std::string category)
+        : name(std::move(name)), category(std::move(category)),
+          start_us(recording ? now_us() : 0) {}
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope() { record(std::move(name), std::move(category), start_us); }
+
+  private:
+    std::string name;
+    std::string category;
+    int64_t start_us;
+};
+
+bool write_chrome_trace(const std::string &fp) {
+    std::ofstream file(fp);
+    if (!file.is_open()) {
+        spdlog::error("[⏱️] ❌ Couldn't write trace '{}'.", fp);
+        return false;
+    }
+    std::lock_guard lock(spans_mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const auto &span = spans[i];
+        file << std::format("{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\","
+                            "\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":{}",
+                            json_escape(span.name), json_escape(span.category),
+                            span.start_us, span.duration_us, getpid(),
+                            span.thread);
+        if (!span.detail.empty())
+            file << ",\"args\":{\"detail\":\"" << json_escape(span.detail)
+                 << "\"}";
+        file << (i + 1 < spans.size() ? "},\n" : "}\n");
+    }
+    file << "]}\n";
+    spdlog::info("[⏱️] ✅ Wrote {} spans to '{}'", spans.size(), fp);
+    return true;
+}
+
+// Total time per category, then the slowest individual spans
+void print_summary() {
+    std::lock_guard lock(spans_mutex);
+    if (spans.empty())
+        return;
+
+    std::map<std::string, std::pair<size_t, int64_t>> categories;
+    for (const auto &span : spans) {
+        auto &[count, total] = categories[span.category];
+        ++count;
+        total += span.duration_us;
+    }
+    spdlog::debug("[⏱️] {:<14} {:>6} {:>11}", "phase", "spans", "total");
+    for (const auto &[category, stats] : categories) {
+        spdlog::debug("[⏱️] {:<14} {:>6} {:>9.1f}ms", category, stats.first,
+                      stats.second / 1000.0);
+    }
+
+    std::vector<const Span *> slowest;
+    for (const auto &span : spans) {
+        slowest.push_back(&span);
+    }
+    auto top = std::min<size_t>(slowest.size(), 10);
+    std::partial_sort(slowest.begin(), slowest.begin() + top, slowest.end(),
+                      [](const auto *a, const auto *b) {
+                          return a->duration_us > b->duration_us;
+                      });
+    spdlog::debug("[⏱️] Slowest spans:");
+    for (size_t i = 0; i < top; ++i) {
+        spdlog::debug("[⏱️] {:>9.1f}ms  [{}] {}",
+                      slowest[i]->duration_us / 1000.0, slowest[i]->category,
+                      slowest[i]->name);
+    }
+}
+} // namespace trace
+
 size_t writeCallback(void *contents, size_t size, size_t nmemb,
                      std::string *userp) {
     userp->append((char *)contents, size * nmemb);
     return size * nmemb;
 }
 
-std::pair<long, std::string> fetchURL(const std::string &url) {
+// Collects response headers with lower-cased names. Redirects and
+// "100 Continue" come with headers of their own, only the last response's
+// are kept.
+size_t headerCallback(char *buffer, size_t size, size_t nitems,
+                      std::map<std::string, std::string> *headers) {
+    std::string line(buffer, size * nitems);
+    if (line.starts_with("HTTP/")) {
+        headers->clear();
+        return size * nitems;
+    }
+    auto colon = line.find(':');
+    if (colon != std::string::npos) {
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        auto value_start = line.find_first_not_of(" \t", colon + 1);
+        auto value_end = line.find_last_not_of("\r\n");
+        if (value_start != std::string::npos && value_end >= value_start) {
+            (*headers)[name] =
+                line.substr(value_start, value_end - value_start + 1);
+        }
+    }
+    return size * nitems;
+}
+
+struct HttpResponse {
+    long status = 0; // 0 if the request never got a response
+    std::string body;
+    std::map<std::string, std::string> headers;
+};
+
+HttpResponse fetchURL(const std::string &url,
+                      const std::vector<std::string> &request_headers = {}) {
+    trace::Scope span("fetch " + url, "network");
     CURL *curl = curl_easy_init();
     CURLcode res;
-    std::string responseBody;
-    long responseCode = 0;
+    HttpResponse response;
 
     if (curl) {
+        struct curl_slist *header_list = nullptr;
+        for (const auto &header : request_headers) {
+            header_list = curl_slist_append(header_list, header.c_str());
+        }
+
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBody);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.headers);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
 
         res = curl_easy_perform(curl);
 
         if (res == CURLE_OK) {
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
         } else {
             std::cerr << "curl_easy_perform() failed: "
                       << curl_easy_strerror(res) << std::endl;
         }
 
+        curl_slist_free_all(header_list);
         curl_easy_cleanup(curl);
     }
 
-    return {responseCode, responseBody};
+    return response;
 }
 
 struct ExecResult {
@@ -101,26 +553,447 @@ struct ExecResult {
     int exit_code;
 };
 
-ExecResult exec(const std::string &cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
+std::string shell_quote(const std::string &arg) {
+    const std::string safe = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                             "0123456789_-+=/.,:@%";
+    if (!arg.empty() && arg.find_first_not_of(safe) == std::string::npos)
+        return arg;
+
+    std::string quoted = "'";
+    for (char c : arg) {
+        if (c == '\'')
+            quoted += "'\\''";
+        else
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+std::string shell_join(const std::vector<std::string> &argv) {
+    std::string cmd;
+    for (const auto &arg : argv) {
+        if (!cmd.empty())
+            cmd += ' ';
+        cmd += shell_quote(arg);
+    }
+    return cmd;
+}
+
+// Runs programs directly with posix_spawn (no /bin/sh in between), reading
+// their output through pipes as it's produced
+namespace process {
+enum class Output {
+    Capture, // Collect stdout+stderr into ExecResult::output
+    Stream,  // Capture, but also echo to the terminal as it arrives
+    Inherit, // Let the child write straight to our stdout/stderr
+};
+
+struct Child {
+    pid_t pid = -1;
+    int out_fd = -1; // Read end of the child's stdout+stderr, -1 once drained
+    Output output = Output::Capture;
+    ExecResult result = {"", -1};
+    bool timed_out = false;
+    int signal = 0; // What killed it, if something other than our timeout
+    bool group = false; // Leads its own process group, which dies with it
+    std::string command; // For the trace
+    int64_t start_us = 0;
+};
+
+// Children in their own group don't see the terminal's Ctrl-C, so it's
+// passed on to them. Slots are atomics so the handler can read them.
+std::array<std::atomic<pid_t>, 256> groups{};
+
+void kill_groups(int sig) {
+    for (auto &group : groups) {
+        pid_t pgid = group.load();
+        if (pgid > 0)
+            kill(-pgid, SIGKILL);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void track_group(pid_t pgid) {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        signal(SIGINT, kill_groups);
+        signal(SIGTERM, kill_groups);
+    });
+    for (auto &group : groups) {
+        pid_t free = 0;
+        if (group.compare_exchange_strong(free, pgid))
+            return;
+    }
+}
+
+void untrack_group(pid_t pgid) {
+    for (auto &group : groups) {
+        pid_t expected = pgid;
+        if (group.compare_exchange_strong(expected, 0))
+            return;
+    }
+}
+
+// Starts `argv` (looked up in PATH) in `cwd`, or ours if empty. On failure
+// the child comes back with pid -1 and the reason in result.output. With
+// `own_group`, anything it forks is killed along with it.
+Child spawn(const std::vector<std::string> &argv,
+            Output output = Output::Capture,
+            const std::filesystem::path &cwd = {}, bool own_group = false) {
+    Child child;
+    child.output = output;
+    if (trace::recording) {
+        child.command = shell_join(argv);
+        child.start_us = trace::now_us();
+    }
+
+    std::vector<char *> args;
+    for (const auto &arg : argv) {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    // O_CLOEXEC matters: children spawned concurrently from other threads
+    // must not inherit this pipe, or we'd never see EOF on it
+    int fds[2] = {-1, -1};
+    if (output != Output::Inherit && pipe2(fds, O_CLOEXEC) != 0) {
+        child.result.output = std::format("pipe() failed: {}", strerror(errno));
+        return child;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (output != Output::Inherit) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                         O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+    }
+    // Threads can't chdir() on their own, the process shares one cwd
+    if (!cwd.empty())
+        posix_spawn_file_actions_addchdir_np(&actions, cwd.c_str());
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    if (own_group) {
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+
+    int err = posix_spawnp(&child.pid, args[0], &actions, &attr, args.data(),
+                           environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (fds[1] >= 0)
+        close(fds[1]);
+
+    if (err != 0) {
+        child.pid = -1;
+        child.result.output =
+            std::format("Couldn't start '{}': {}", argv[0], strerror(err));
+        if (fds[0] >= 0)
+            close(fds[0]);
+        return child;
+    }
+    child.out_fd = fds[0];
+    child.group = own_group;
+    if (own_group)
+        track_group(child.pid);
+    return child;
+}
+
+void kill_child(const Child &child) {
+    kill(child.group ? -child.pid : child.pid, SIGKILL);
+}
+
+// Waits for every child at once, draining all their pipes with poll() as
+// output arrives. Children still running after `timeout` are killed.
+void wait_all(std::vector<Child *> children,
+              std::optional<std::chrono::milliseconds> timeout = std::nullopt) {
+    auto deadline = timeout ? std::optional(std::chrono::steady_clock::now() +
+                                            *timeout)
+                            : std::nullopt;
+    std::array<char, 64 * 1024> buffer;
 
-    FILE *pipe = popen(cmd.c_str(), "r");
-    if (!pipe)
-        throw std::runtime_error("popen() failed!");
+    while (true) {
+        std::vector<pollfd> fds;
+        std::vector<Child *> polled;
+        for (auto *child : children) {
+            if (child->out_fd >= 0) {
+                fds.push_back({child->out_fd, POLLIN, 0});
+                polled.push_back(child);
+            }
+        }
+        if (fds.empty())
+            break;
+
+        int wait_ms = -1;
+        if (deadline) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                *deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                for (auto *child : polled) {
+                    kill_child(*child);
+                    child->timed_out = true;
+                    close(child->out_fd);
+                    child->out_fd = -1;
+                }
+                break;
+            }
+            wait_ms = (int)left.count();
+        }
+
+        if (poll(fds.data(), fds.size(), wait_ms) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (!fds[i].revents)
+                continue;
+            auto *child = polled[i];
+            ssize_t n = read(child->out_fd, buffer.data(), buffer.size());
+            if (n > 0) {
+                child->result.output.append(buffer.data(), n);
+                if (child->output == Output::Stream) {
+                    fwrite(buffer.data(), 1, n, stdout);
+                    fflush(stdout);
+                }
+            } else if (n == 0 || errno != EINTR) {
+                close(child->out_fd);
+                child->out_fd = -1;
+            }
+        }
+    }
+
+    for (auto *child : children) {
+        if (child->pid < 0)
+            continue;
+        int status = 0;
+        if (deadline && !child->timed_out) {
+            // Inherit-mode children have no pipe to time out on. WNOWAIT
+            // leaves it to be reaped below.
+            while (true) {
+                siginfo_t info = {};
+                int done = waitid(P_PID, child->pid, &info,
+                                  WEXITED | WNOHANG | WNOWAIT);
+                if (done == 0 && info.si_pid == child->pid)
+                    break;
+                if (done < 0 && errno != EINTR)
+                    break;
+                if (std::chrono::steady_clock::now() >= *deadline) {
+                    kill_child(*child);
+                    child->timed_out = true;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        if (child->group) {
+            // Whatever it left running goes too. Until it's reaped, the
+            // zombie keeps the group's id from being reused.
+            siginfo_t info;
+            while (waitid(P_PID, child->pid, &info, WEXITED | WNOWAIT) < 0 &&
+                   errno == EINTR) {
+            }
+            kill(-child->pid, SIGKILL);
+            untrack_group(child->pid);
+        }
+        while (waitpid(child->pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        child->result.exit_code =
+            WIFEXITED(status) && !child->timed_out ? WEXITSTATUS(status) : -1;
+        child->signal =
+            WIFSIGNALED(status) && !child->timed_out ? WTERMSIG(status) : 0;
+        child->pid = -1;
+        if (trace::recording) {
+            auto program = child->command.substr(0, child->command.find(' '));
+            trace::record(std::filesystem::path(program).filename().string(),
+                          "process", child->start_us, child->command);
+        }
+    }
+}
+
+ExecResult run(const std::vector<std::string> &argv,
+               Output output = Output::Capture,
+               const std::filesystem::path &cwd = {}) {
+    auto child = spawn(argv, output, cwd);
+    wait_all({&child});
+    return child.result;
+}
+} // namespace process
+
+// Collects a job's log lines so they can be printed in one piece once it's
+// done, instead of interleaving with whatever else is running
+struct JobLog {
+    std::vector<std::pair<spdlog::level::level_enum, std::string>> lines;
+
+    template <typename... Args>
+    void info(std::format_string<Args...> fmt, Args &&...args) {
+        lines.emplace_back(spdlog::level::info,
+                           std::format(fmt, std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    void warn(std::format_string<Args...> fmt, Args &&...args) {
+        lines.emplace_back(spdlog::level::warn,
+                           std::format(fmt, std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    void error(std::format_string<Args...> fmt, Args &&...args) {
+        lines.emplace_back(spdlog::level::err,
+                           std::format(fmt, std::forward<Args>(args)...));
+    }
+
+    void flush() {
+        for (const auto &[level, line] : lines) {
+            spdlog::log(level, "{}", line);
+        }
+        lines.clear();
+    }
+};
+
+struct Job {
+    std::string name;
+    std::function<bool(JobLog &)> run;
+};
+
+// Job slots shared between dreamcpp processes, like make's jobserver: a
+// pipe holding one byte per free slot beyond the one every process gets
+// for free. A workspace build sets it up, and its member builds find it
+// through DREAMCPP_JOBSERVER, so they all share -j instead of multiplying it.
+namespace jobserver {
+const char *ENV = "DREAMCPP_JOBSERVER";
+int read_fd = -1;
+int write_fd = -1;
+
+// Picks up the pipe our parent passed down, if any
+bool active() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        const char *value = std::getenv(ENV);
+        int r = -1, w = -1;
+        if (value == nullptr || sscanf(value, "%d,%d", &r, &w) != 2)
+            return;
+        if (fcntl(r, F_GETFD) < 0 || fcntl(w, F_GETFD) < 0) {
+            spdlog::warn("[⚒️] ⚠️ Ignoring {}, its pipe wasn't passed down",
+                         ENV);
+            return;
+        }
+        read_fd = r;
+        write_fd = w;
+    });
+    return read_fd >= 0;
+}
+
+// `slots` in total, counting ours. Children spawned from here on inherit it.
+bool create(unsigned slots) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        spdlog::error("[⚒️] ❌ Couldn't create the jobserver: {}",
+                      strerror(errno));
+        return false;
+    }
+    // Non-blocking, so acquire() can give up once there's nothing left to
+    // run (this is shared with every process that inherits the pipe)
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    std::string tokens(slots > 0 ? slots - 1 : 0, '+');
+    if (!tokens.empty() && write(fds[1], tokens.data(), tokens.size()) !=
+                               (ssize_t)tokens.size()) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    active(); // Settle the env lookup before we change it
+    read_fd = fds[0];
+    write_fd = fds[1];
+    setenv(ENV, std::format("{},{}", read_fd, write_fd).c_str(), 1);
+    return true;
+}
+
+// Waits for a free slot, or returns false once `wanted` says it's no
+// longer needed
+bool acquire(const std::function<bool()> &wanted) {
+    while (wanted()) {
+        char token;
+        ssize_t n = read(read_fd, &token, 1);
+        if (n == 1)
+            return true;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            return false;
+        pollfd fd = {read_fd, POLLIN, 0};
+        poll(&fd, 1, 50);
+    }
+    return false;
+}
 
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+void release() {
+    char token = '+';
+    while (write(write_fd, &token, 1) < 0 && errno == EINTR) {
     }
+}
+} // namespace jobserver
+
+// Runs jobs on up to `max_parallel` threads. Without `keep_going`, no new job
+// is started after the first failure (running ones are still waited for).
+// Returns true only if every job ran and succeeded.
+bool run_jobs(std::vector<Job> &jobs, unsigned max_parallel,
+              bool keep_going = false) {
+    if (jobs.empty())
+        return true;
+
+    std::mutex output_mutex;
+    std::atomic<size_t> next_job = 0;
+    std::atomic<bool> failed = false;
+
+    // Only extra threads need a jobserver slot, the calling one has its own
+    auto worker = [&](bool needs_slot) {
+        while (keep_going || !failed) {
+            if (needs_slot && !jobserver::acquire([&]() {
+                    return (keep_going || !failed) && next_job < jobs.size();
+                }))
+                return;
+            size_t i = next_job++;
+            if (i >= jobs.size()) {
+                if (needs_slot)
+                    jobserver::release();
+                return;
+            }
+
+            JobLog log;
+            bool ok = false;
+            try {
+                ok = jobs[i].run(log);
+            } catch (const std::exception &e) {
+                log.error("❌ Job '{}' threw: {}", jobs[i].name, e.what());
+            }
+            if (!ok)
+                failed = true;
+            if (needs_slot)
+                jobserver::release();
+
+            std::lock_guard lock(output_mutex);
+            log.flush();
+        }
+    };
 
-    int status = pclose(pipe);
-    int exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    size_t thread_count = std::clamp<size_t>(max_parallel, 1, jobs.size());
+    bool shared = jobserver::active();
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker, shared);
+    }
+    worker(false); // The calling thread pulls its weight too
+    for (auto &thread : threads) {
+        thread.join();
+    }
 
-    return {result, exit_code};
+    return !failed && next_job >= jobs.size();
 }
 
 std::optional<AppConfig> parse_config_file(const std::string &fp,
                                            const std::string &project_name) {
+    trace::Scope span("parse_config_file " + fp, "config");
     AppConfig config;
     try {
         toml::table tbl = toml::parse_file(fp);
@@ -129,6 +1002,7 @@ std::optional<AppConfig> parse_config_file(const std::string &fp,
         maybe_assign(tbl, "version", config.version);
         maybe_assign(tbl, "standard", config.standard);
         maybe_assign(tbl, "preferred_compiler", config.preferred_compiler);
+        config.linker = tbl["linker"].value<std::string>();
 
         if (auto arr = tbl["includes"].as_array()) {
             config.includes.clear(); // Clear defaults
@@ -138,6 +1012,42 @@ std::optional<AppConfig> parse_config_file(const std::string &fp,
             }
         }
 
+        if (auto profiles = tbl["profiles"].as_table()) {
+            for (const auto &[name, val] : *profiles) {
+                auto ptbl = val.as_table();
+                if (!ptbl)
+                    continue;
+                ProfileConfig profile;
+                profile.inherits = (*ptbl)["inherits"].value<std::string>();
+                profile.opt_level = (*ptbl)["opt"].value<std::string>();
+                // `opt = 2` is the obvious thing to write, so take integers too
+                if (auto level = (*ptbl)["opt"].value<int64_t>())
+                    profile.opt_level = std::to_string(*level);
+                profile.debug_info = (*ptbl)["debug"].value<bool>();
+                profile.lto = (*ptbl)["lto"].value<std::string>();
+                profile.output_dir = (*ptbl)["output"].value<std::string>();
+                profile.pgo_train = (*ptbl)["pgo_train"].value<std::string>();
+                profile.unity = (*ptbl)["unity"].value<int64_t>();
+                profile.linker = (*ptbl)["linker"].value<std::string>();
+                profile.split_debug = (*ptbl)["split_debug"].value<bool>();
+                auto strings = [&](const char *key)
+                    -> std::optional<std::vector<std::string>> {
+                    auto arr = (*ptbl)[key].as_array();
+                    if (!arr)
+                        return std::nullopt;
+                    std::vector<std::string> out;
+                    for (const auto &item : *arr) {
+                        if (auto str = item.value<std::string>())
+                            out.push_back(*str);
+                    }
+                    return out;
+                };
+                profile.flags = strings("flags");
+                profile.link_flags = strings("link_flags");
+                config.profiles[std::string(name.str())] = profile;
+            }
+        }
+
         if (auto arr = tbl["dependencies"].as_array()) {
             config.deps.clear(); // Clear defaults
             for (const auto &val : *arr) {
@@ -146,6 +1056,12 @@ std::optional<AppConfig> parse_config_file(const std::string &fp,
                     dep.name = (*tbldep)["name"].value_or("unknown");
                     dep.version = (*tbldep)["version"].value_or("latest");
                     dep.system = (*tbldep)["system"].value_or(false);
+                    if (!valid_dep_name(dep.name)) {
+                        spdlog::error("[📖] ❌ '{}' isn't a valid dependency "
+                                      "name",
+                                      dep.name);
+                        return std::nullopt;
+                    }
                     if (!dep.name.empty() && dep.name != "unknown") {
                         config.deps.push_back(dep);
                     }
@@ -166,6 +1082,7 @@ std::optional<AppConfig> parse_config_file(const std::string &fp,
 
 std::optional<std::map<std::string, DepIndex>>
 parse_repository_index(const std::string &tomlstr) {
+    trace::Scope span("parse_repository_index", "index");
     try {
         toml::table tbl = toml::parse(tomlstr);
         std::map<std::string, DepIndex> depmap;
@@ -185,12 +1102,51 @@ parse_repository_index(const std::string &tomlstr) {
                     }
                 }
 
+                if (auto deps_arr = (*vtbl)["dependencies"].as_array()) {
+                    for (const auto &name : *deps_arr) {
+                        if (auto name_str = name.value<std::string>())
+                            dep.dependencies.push_back(*name_str);
+                    }
+                }
+
                 // Handle optional branch
                 if (auto branch_val = (*vtbl)["branch"].value<std::string>()) {
                     dep.branch = *branch_val;
                 }
+                if (auto rev_val = (*vtbl)["rev"].value<std::string>()) {
+                    dep.rev = *rev_val;
+                }
+                dep.archive = (*vtbl)["archive"].value<std::string>();
+                dep.sha256 = (*vtbl)["sha256"].value<std::string>();
+                if (auto strip = (*vtbl)["strip"].value<int64_t>())
+                    dep.strip = (uint32_t)std::max<int64_t>(*strip, 0);
+
+                // A bad name anywhere in an entry makes the whole entry bad
+                std::vector<std::string> names = {std::string(k)};
+                names.insert(names.end(), dep.aliases.begin(),
+                             dep.aliases.end());
+                names.insert(names.end(), dep.dependencies.begin(),
+                             dep.dependencies.end());
+                auto bad = std::find_if_not(names.begin(), names.end(),
+                                            [](const std::string &name) {
+                                                return valid_dep_name(name);
+                                            });
+                if (bad != names.end()) {
+                    spdlog::warn("[📖] ⚠️ Skipping index entry '{}': '{}' "
+                                 "isn't a valid dependency name",
+                                 std::string(k), *bad);
+                    continue;
+                }
+                if (option_like(dep.git) || option_like(dep.rev.value_or("")) ||
+                    option_like(dep.branch.value_or(""))) {
+                    spdlog::warn("[📖] ⚠️ Skipping index entry '{}': its git, "
+                                 "rev or branch starts with '-'",
+                                 std::string(k));
+                    continue;
+                }
 
-                if (!dep.git.empty()) { // Only add if git URL exists
+                // Only add if there's somewhere to get it from
+                if (!dep.git.empty() || dep.archive.has_value()) {
                     depmap[std::string(k)] = dep;
                 }
             }
@@ -230,6 +1186,42 @@ toml::table serialise_config(const AppConfig &config) {
 
     tbl.insert("standard", config.standard);
     tbl.insert("preferred_compiler", config.preferred_compiler);
+    if (config.linker.has_value())
+        tbl.insert("linker", *config.linker);
+
+    // Only what the user wrote, so built-in defaults can still change later
+    if (!config.profiles.empty()) {
+        toml::table profiles;
+        for (const auto &[name, profile] : config.profiles) {
+            toml::table ptbl;
+            auto maybe_insert = [&](const char *key, const auto &value) {
+                if (value.has_value())
+                    ptbl.insert(key, *value);
+            };
+            maybe_insert("inherits", profile.inherits);
+            maybe_insert("opt", profile.opt_level);
+            maybe_insert("debug", profile.debug_info);
+            maybe_insert("lto", profile.lto);
+            maybe_insert("output", profile.output_dir);
+            maybe_insert("pgo_train", profile.pgo_train);
+            maybe_insert("unity", profile.unity);
+            maybe_insert("linker", profile.linker);
+            maybe_insert("split_debug", profile.split_debug);
+            for (const auto &[key, flags] :
+                 {std::pair{"flags", &profile.flags},
+                  std::pair{"link_flags", &profile.link_flags}}) {
+                if (!flags->has_value())
+                    continue;
+                toml::array arr;
+                for (const auto &flag : **flags) {
+                    arr.push_back(flag);
+                }
+                ptbl.insert(key, arr);
+            }
+            profiles.insert(name, ptbl);
+        }
+        tbl.insert("profiles", profiles);
+    }
 
     return tbl;
 }
@@ -251,297 +1243,6483 @@ bool sync_config(const toml::table &tbl, const std::string &fp) {
     }
 }
 
-namespace dependency {
-bool validate_project_environment() {
-    if (!std::filesystem::exists("dreamcpp.toml")) {
-        spdlog::error("[🚀] ❌ This... isn't a 🌌++ project.");
-        return false;
+// Local indexes are compiled once into a flat binary hash table (names and
+// aliases -> entries) and memory-mapped, so resolving a package needs
+// neither a TOML parse nor a linear scan over every alias.
+namespace local_index {
+constexpr std::array<char, 8> MAGIC = {'D', 'C', 'P', 'P', 'I', 'D', 'X', '3'};
+constexpr uint32_t NONE = UINT32_MAX;
+
+struct StrRef {
+    uint32_t offset = 0;
+    uint32_t length = NONE; // NONE = field not set
+};
+
+struct Header {
+    std::array<char, 8> magic;
+    int64_t source_mtime; // Of the .toml this was compiled from
+    uint64_t source_size;
+    uint32_t slot_count; // Always a power of two
+    uint32_t entry_count;
+    uint64_t entries_offset;
+    uint64_t slots_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct Entry {
+    StrRef git;
+    StrRef branch;
+    StrRef rev;
+    StrRef aliases; // Newline separated
+    uint32_t header_only;
+    StrRef archive;
+    StrRef sha256;
+    uint32_t strip;
+    StrRef dependencies; // Newline separated
+};
+
+struct Slot {
+    uint32_t hash;
+    uint32_t entry; // NONE = empty slot
+    StrRef key;
+};
+
+uint32_t hash_key(std::string_view key) { return (uint32_t)fnv1a(key); }
+
+std::string compile(const std::map<std::string, DepIndex> &index,
+                    int64_t source_mtime, uint64_t source_size) {
+    std::string strings;
+    auto add_string = [&](std::string_view str) {
+        StrRef ref{(uint32_t)strings.size(), (uint32_t)str.size()};
+        strings += str;
+        return ref;
+    };
+    auto lines = [](const std::vector<std::string> &items) {
+        std::string joined;
+        for (const auto &item : items) {
+            joined += (joined.empty() ? "" : "\n") + item;
+        }
+        return joined;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    for (const auto &[name, dep] : index) {
+        Entry entry{};
+        entry.git = add_string(dep.git);
+        entry.branch = dep.branch ? add_string(*dep.branch) : StrRef{};
+        entry.rev = dep.rev ? add_string(*dep.rev) : StrRef{};
+        entry.aliases = add_string(lines(dep.aliases));
+        entry.header_only = dep.header_only;
+        entry.archive = dep.archive ? add_string(*dep.archive) : StrRef{};
+        entry.sha256 = dep.sha256 ? add_string(*dep.sha256) : StrRef{};
+        entry.strip = dep.strip;
+        entry.dependencies = add_string(lines(dep.dependencies));
+        keys.emplace_back(name, (uint32_t)entries.size());
+        entries.push_back(entry);
+    }
+    // Aliases go in after every real name, so a name always wins
+    for (size_t i = 0; const auto &[name, dep] : index) {
+        for (const auto &alias : dep.aliases) {
+            keys.emplace_back(alias, (uint32_t)i);
+        }
+        ++i;
     }
 
-    if (system("git --version > /dev/null 2>&1") != 0) { // Better git check
-        spdlog::error("[🚀] ❌ You don't have git installed. :P");
-        return false;
+    // Open addressing with linear probing, kept at most half full
+    uint32_t slot_count = 8;
+    while (slot_count < keys.size() * 2) {
+        slot_count *= 2;
+    }
+    std::vector<Slot> slots(slot_count, Slot{0, NONE, {}});
+    for (const auto &[key, entry] : keys) {
+        uint32_t hash = hash_key(key);
+        for (uint32_t i = hash & (slot_count - 1);; i = (i + 1) & (slot_count - 1)) {
+            if (slots[i].entry == NONE) {
+                slots[i] = {hash, entry, add_string(key)};
+                break;
+            }
+            if (slots[i].hash == hash &&
+                std::string_view(strings).substr(slots[i].key.offset,
+                                                 slots[i].key.length) == key) {
+                break; // Duplicate key, first one wins
+            }
+        }
     }
 
-    return true;
+    auto align = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+    Header header{};
+    header.magic = MAGIC;
+    header.source_mtime = source_mtime;
+    header.source_size = source_size;
+    header.slot_count = slot_count;
+    header.entry_count = (uint32_t)entries.size();
+    header.entries_offset = align(sizeof(Header));
+    header.slots_offset =
+        align(header.entries_offset + entries.size() * sizeof(Entry));
+    header.strings_offset = align(header.slots_offset + slots.size() * sizeof(Slot));
+    header.strings_size = strings.size();
+
+    std::string out(header.strings_offset + strings.size(), '\0');
+    std::memcpy(out.data(), &header, sizeof(Header));
+    std::memcpy(out.data() + header.entries_offset, entries.data(),
+                entries.size() * sizeof(Entry));
+    std::memcpy(out.data() + header.slots_offset, slots.data(),
+                slots.size() * sizeof(Slot));
+    std::memcpy(out.data() + header.strings_offset, strings.data(),
+                strings.size());
+    return out;
 }
 
-std::optional<std::string> search_local_indexes(const std::string &dep_name) {
-    const std::vector<std::string> search_paths = {
-        std::string(getenv("HOME") ? getenv("HOME") : "~") +
-            "/.dreamcpp/index", // Expand ~ properly
-        "../index"};
+class Table {
+  public:
+    Table(void *data, size_t size) : data((const char *)data), size(size) {}
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+    ~Table() { munmap((void *)data, size); }
 
-    for (const auto &path : search_paths) {
-        if (std::filesystem::exists(path)) {
-            // TODO: Implement actual search logic here
-            // For now, just continue to remote search
-            continue;
+    // Maps `fp`, returning nullptr unless it's a complete, valid table
+    static std::unique_ptr<Table> map(const std::string &fp) {
+        int fd = open(fp.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header)) {
+            data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
         }
-    }
+        close(fd);
+        if (data == MAP_FAILED)
+            return nullptr;
 
-    return std::nullopt;
-}
+        auto table = std::make_unique<Table>(data, st.st_size);
+        const auto &h = table->header();
+        bool valid =
+            h.magic == MAGIC && h.slot_count &&
+            (h.slot_count & (h.slot_count - 1)) == 0 &&
+            h.entries_offset + (uint64_t)h.entry_count * sizeof(Entry) <=
+                table->size &&
+            h.slots_offset + (uint64_t)h.slot_count * sizeof(Slot) <=
+                table->size &&
+            h.strings_offset + h.strings_size <= table->size;
+        return valid ? std::move(table) : nullptr;
+    }
 
-std::optional<DepIndex> search_remote_index(const std::string &dep_name) {
-    const std::string index_url =
-        "https://raw.githubusercontent.com/frinkifail/dreamcpp/refs/heads/main/"
-        "index/dcpp%3Acore.toml";
+    const Header &header() const { return *(const Header *)data; }
 
-    auto response = fetchURL(index_url);
-    if (response.first != 200) {
-        spdlog::warn("[🚀] ⚠️ Failed to fetch remote index (HTTP {})",
-                     response.first);
+    std::optional<DepIndex> find(std::string_view name) const {
+        const auto &h = header();
+        auto slots = (const Slot *)(data + h.slots_offset);
+        uint32_t hash = hash_key(name);
+        for (uint32_t i = hash & (h.slot_count - 1), probes = 0;
+             probes < h.slot_count; i = (i + 1) & (h.slot_count - 1), ++probes) {
+            const auto &slot = slots[i];
+            if (slot.entry == NONE || slot.entry >= h.entry_count)
+                return std::nullopt;
+            if (slot.hash == hash && str(slot.key) == name)
+                return to_dep(((const Entry *)(data + h.entries_offset))[slot.entry]);
+        }
         return std::nullopt;
     }
 
-    auto index = parse_repository_index(response.second);
-    if (!index.has_value()) {
-        return std::nullopt;
+  private:
+    const char *data;
+    size_t size;
+
+    std::optional<std::string_view> str(StrRef ref) const {
+        const auto &h = header();
+        if (ref.length == NONE || (uint64_t)ref.offset + ref.length > h.strings_size)
+            return std::nullopt;
+        return std::string_view(data + h.strings_offset + ref.offset, ref.length);
     }
 
-    // Direct lookup first
-    auto dep = get_or_nullopt(index.value(), dep_name);
-    if (dep.has_value()) {
+    DepIndex to_dep(const Entry &entry) const {
+        DepIndex dep;
+        dep.git = str(entry.git).value_or("");
+        if (auto branch = str(entry.branch))
+            dep.branch = std::string(*branch);
+        if (auto rev = str(entry.rev))
+            dep.rev = std::string(*rev);
+        auto lines = [](std::optional<std::string_view> joined) {
+            std::vector<std::string> items;
+            std::istringstream stream(std::string(joined.value_or("")));
+            for (std::string item; std::getline(stream, item);) {
+                items.push_back(item);
+            }
+            return items;
+        };
+        dep.aliases = lines(str(entry.aliases));
+        dep.header_only = entry.header_only;
+        if (auto archive = str(entry.archive))
+            dep.archive = std::string(*archive);
+        if (auto sha256 = str(entry.sha256))
+            dep.sha256 = std::string(*sha256);
+        dep.strip = entry.strip;
+        dep.dependencies = lines(str(entry.dependencies));
         return dep;
     }
+};
 
-    // Search aliases
-    for (const auto &[key, value] : index.value()) {
-        auto it =
-            std::find(value.aliases.begin(), value.aliases.end(), dep_name);
-        if (it != value.aliases.end()) {
+// Maps the compiled table for `toml_path`, (re)compiling it into
+// ~/.dreamcpp/cache/index/local first if the TOML changed since
+std::unique_ptr<Table> open_index(const std::filesystem::path &toml_path) {
+    std::error_code ec;
+    auto canonical = std::filesystem::canonical(toml_path, ec);
+    if (ec)
+        return nullptr;
+    auto mtime = std::filesystem::last_write_time(canonical, ec)
+                     .time_since_epoch()
+                     .count();
+    auto size = std::filesystem::file_size(canonical, ec);
+    if (ec)
+        return nullptr;
+
+    auto compiled = dreamcpp_home() / "cache" / "index" / "local" /
+                    std::format("{:016x}.idx", fnv1a(canonical.string()));
+    if (auto table = Table::map(compiled.string())) {
+        if (table->header().source_mtime == mtime &&
+            table->header().source_size == size) {
+            return table;
+        }
+    }
+
+    std::ifstream file(canonical);
+    std::string tomlstr((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    auto index = parse_repository_index(tomlstr);
+    if (!index.has_value())
+        return nullptr;
+
+    std::filesystem::create_directories(compiled.parent_path(), ec);
+    auto tmp = compiled;
+    tmp += std::format(".tmp{}", getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out << compile(*index, mtime, size);
+    }
+    std::filesystem::rename(tmp, compiled, ec);
+    return Table::map(compiled.string());
+}
+} // namespace local_index
+
+// Pinned releases can come as a .tar.gz instead of a git repo. The archive
+// is never held in memory or written to disk whole: curl hands each chunk to
+// the extractor, which hashes it, inflates it, and writes out whatever tar
+// entries it completes.
+namespace archive {
+class TarGz {
+  public:
+    // `strip` leading path components come off every entry, like tar's
+    // --strip-components (release tarballs have a "name-1.2.3/" dir)
+    TarGz(std::filesystem::path root, unsigned strip)
+        : root(std::move(root)), strip(strip) {
+        // 15 + 32: the biggest window, and take a gzip or zlib header
+        ok = inflateInit2(&zs, 15 + 32) == Z_OK;
+        if (!ok)
+            fail("couldn't initialise zlib");
+    }
+    TarGz(const TarGz &) = delete;
+    TarGz &operator=(const TarGz &) = delete;
+    ~TarGz() { inflateEnd(&zs); }
+
+    // More of the compressed stream, false once something went wrong
+    bool feed(const char *data, size_t size) {
+        if (!ok)
+            return false;
+        hasher.update(std::string_view(data, size));
+        if (inflated)
+            return true; // Trailing bytes after the gzip stream
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)size;
+        char buffer[1 << 16];
+        while (ok && zs.avail_in > 0) {
+            zs.next_out = (Bytef *)buffer;
+            zs.avail_out = sizeof(buffer);
+            int status = inflate(&zs, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                fail(std::format("not a valid gzip stream ({})",
+                                 zs.msg ? zs.msg : "inflate failed"));
+                break;
+            }
+            untar(buffer, sizeof(buffer) - zs.avail_out);
+            if (status == Z_STREAM_END) {
+                inflated = true;
+                break;
+            }
+        }
+        return ok;
+    }
+
+    // Whether the stream ended where a complete archive would
+    bool finish() {
+        if (ok && (!inflated || !ended))
+            fail("the archive is truncated");
+        close_file();
+        return ok;
+    }
+
+    // SHA-256 of everything fed in so far
+    std::string digest() { return hasher.hex(); }
+    const std::string &error() const { return message; }
+
+  private:
+    // What the data after a header is for
+    enum class Kind { Skip, File, LongName, LongLink, Pax };
+
+    std::filesystem::path root;
+    unsigned strip;
+    z_stream zs = {};
+    Sha256 hasher;
+    bool ok = true;
+    bool inflated = false; // Reached the end of the gzip stream
+    bool ended = false;    // Reached the tar's end-of-archive block
+    std::string message;
+
+    std::string header;      // Collects 512-byte headers across chunks
+    uint64_t remaining = 0;  // Data bytes left in the current entry
+    uint64_t padding = 0;    // Then this many to the next 512 boundary
+    Kind kind = Kind::Skip;
+    std::ofstream file;
+    std::filesystem::path file_path;
+    bool executable = false;
+    std::string meta;        // Data of LongName/LongLink/Pax entries
+    std::string long_name;   // Apply to the next entry only
+    std::string long_link;
+
+    void fail(std::string why) {
+        if (ok)
+            message = std::move(why);
+        ok = false;
+    }
+
+    void untar(const char *data, size_t size) {
+        while (ok && size > 0 && !ended) {
+            if (remaining > 0) {
+                auto take = (size_t)std::min<uint64_t>(remaining, size);
+                if (kind == Kind::File)
+                    file.write(data, take);
+                else if (kind != Kind::Skip)
+                    meta.append(data, take);
+                data += take;
+                size -= take;
+                remaining -= take;
+                if (remaining == 0)
+                    end_entry();
+            } else if (padding > 0) {
+                auto take = (size_t)std::min<uint64_t>(padding, size);
+                data += take;
+                size -= take;
+                padding -= take;
+            } else {
+                auto take = std::min(size, 512 - header.size());
+                header.append(data, take);
+                data += take;
+                size -= take;
+                if (header.size() == 512) {
+                    start_entry();
+                    header.clear();
+                }
+            }
+        }
+    }
+
+    // Octal, or base-256 for big sizes (GNU)
+    static uint64_t number(std::string_view field) {
+        uint64_t value = 0;
+        if (!field.empty() && (unsigned char)field[0] & 0x80) {
+            for (size_t i = 1; i < field.size(); ++i) {
+                value = (value << 8) | (unsigned char)field[i];
+            }
             return value;
         }
+        for (char c : field) {
+            if (c >= '0' && c <= '7')
+                value = value * 8 + (c - '0');
+            else if (c != ' ' || value != 0)
+                break;
+        }
+        return value;
+    }
+
+    static std::string text(std::string_view field) {
+        return std::string(field.substr(0, field.find('\0')));
+    }
+
+    // Where an entry goes (the root itself if stripping left nothing), or
+    // nothing if it would land outside the root
+    std::optional<std::filesystem::path> destination(const std::string &name) {
+        auto relative = std::filesystem::path(name).lexically_normal();
+        if (relative.is_absolute())
+            return std::nullopt;
+        std::filesystem::path kept;
+        unsigned depth = 0;
+        for (const auto &part : relative) {
+            if (part == "..")
+                return std::nullopt;
+            if (part.empty() || part == ".")
+                continue;
+            if (depth++ >= strip)
+                kept /= part;
+        }
+        return kept.empty() ? root : root / kept;
+    }
+
+    // Whether a dir between the root and `path` is a symlink. Link targets
+    // are only checked lexically, so a chain of links (a/b -> .., then
+    // a/b/c -> ..) could otherwise walk a later entry out of the root.
+    bool through_symlink(const std::filesystem::path &path) {
+        auto relative = path.lexically_relative(root);
+        auto current = root;
+        for (auto part = relative.begin(); part != relative.end(); ++part) {
+            if (std::next(part) == relative.end())
+                break;
+            current /= *part;
+            std::error_code ec;
+            if (std::filesystem::is_symlink(
+                    std::filesystem::symlink_status(current, ec)))
+                return true;
+        }
+        return false;
+    }
+
+    void start_entry() {
+        if (header.find_first_not_of('\0') == std::string::npos) {
+            ended = true; // The first of two zero blocks
+            return;
+        }
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < 512; ++i) {
+            checksum += (i >= 148 && i < 156) ? ' ' : (unsigned char)header[i];
+        }
+        if (checksum != number(std::string_view(header).substr(148, 8))) {
+            fail("bad tar header checksum");
+            return;
+        }
+
+        std::string_view h(header);
+        uint64_t size = number(h.substr(124, 12));
+        char type = h[156];
+        std::string name = text(h.substr(0, 100));
+        if (h.substr(257, 5) == "ustar" && h[345] != '\0')
+            name = text(h.substr(345, 155)) + "/" + name;
+        std::string link = text(h.substr(157, 100));
+        if (!long_name.empty())
+            name = std::exchange(long_name, "");
+        if (!long_link.empty())
+            link = std::exchange(long_link, "");
+
+        remaining = size;
+        padding = (512 - size % 512) % 512;
+        kind = Kind::Skip;
+        meta.clear();
+        switch (type) {
+        case 'L':
+            kind = Kind::LongName;
+            break;
+        case 'K':
+            kind = Kind::LongLink;
+            break;
+        case 'x':
+            kind = Kind::Pax;
+            break;
+        case '0':
+        case '\0':
+        case '7':
+        case '5':
+        case '2':
+        case '1': {
+            auto path = destination(name);
+            if (!path.has_value()) {
+                fail(std::format("'{}' would extract outside the dep", name));
+                return;
+            }
+            if (*path == root)
+                break; // Stripped away, like the top-level dir itself
+            if (through_symlink(*path)) {
+                fail(std::format("'{}' would extract through a symlink", name));
+                return;
+            }
+            std::error_code ec, ignored;
+            // A file replaces a link of the same name, never writes through it
+            if (type != '5' &&
+                std::filesystem::is_symlink(
+                    std::filesystem::symlink_status(*path, ignored)))
+                std::filesystem::remove(*path, ignored);
+            std::filesystem::create_directories(
+                type == '5' ? *path : path->parent_path(), ec);
+            if (type == '2') {
+                // Links may point anywhere inside the dep, but no further
+                auto target = (path->parent_path() / link).lexically_normal();
+                auto inside = target.lexically_relative(root);
+                if (link.empty() || std::filesystem::path(link).is_absolute() ||
+                    inside.empty() || *inside.begin() == "..") {
+                    fail(std::format("'{}' links outside the dep", name));
+                    return;
+                }
+                std::filesystem::create_symlink(link, *path, ec);
+            } else if (type == '1') {
+                auto target = destination(link);
+                if (!target.has_value() || through_symlink(*target) ||
+                    std::filesystem::is_symlink(
+                        std::filesystem::symlink_status(*target, ignored))) {
+                    fail(std::format("'{}' links outside the dep", name));
+                    return;
+                }
+                std::filesystem::copy_file(
+                    *target, *path,
+                    std::filesystem::copy_options::overwrite_existing, ec);
+            } else if (type != '5') {
+                file.open(*path, std::ios::binary | std::ios::trunc);
+                if (!file.is_open()) {
+                    fail(std::format("couldn't write {}", path->string()));
+                    return;
+                }
+                file_path = *path;
+                executable = number(h.substr(100, 8)) & 0100;
+                kind = Kind::File;
+            }
+            if (ec) {
+                fail(std::format("couldn't extract '{}': {}", name,
+                                 ec.message()));
+                return;
+            }
+            break;
+        }
+        default:
+            break; // Devices, FIFOs, global pax headers...
+        }
+        if (remaining == 0)
+            end_entry();
+    }
+
+    void end_entry() {
+        if (kind == Kind::File) {
+            close_file();
+        } else if (kind == Kind::LongName) {
+            long_name = text(meta);
+        } else if (kind == Kind::LongLink) {
+            long_link = text(meta);
+        } else if (kind == Kind::Pax) {
+            // "<length> <key>=<value>\n" records
+            size_t pos = 0;
+            while (pos < meta.size()) {
+                size_t space = meta.find(' ', pos);
+                if (space == std::string::npos)
+                    break;
+                size_t length = std::strtoull(meta.c_str() + pos, nullptr, 10);
+                if (length == 0 || pos + length > meta.size())
+                    break;
+                auto record = std::string_view(meta).substr(
+                    space + 1, pos + length - space - 2);
+                auto equals = record.find('=');
+                if (equals != std::string::npos) {
+                    auto key = record.substr(0, equals);
+                    auto value = std::string(record.substr(equals + 1));
+                    if (key == "path")
+                        long_name = value;
+                    else if (key == "linkpath")
+                        long_link = value;
+                }
+                pos += length;
+            }
+        }
+        kind = Kind::Skip;
+    }
+
+    void close_file() {
+        if (!file.is_open())
+            return;
+        file.close();
+        if (!file)
+            fail(std::format("couldn't write {}", file_path.string()));
+        if (executable) {
+            std::error_code ec;
+            std::filesystem::permissions(
+                file_path,
+                std::filesystem::perms::owner_exec |
+                    std::filesystem::perms::group_exec |
+                    std::filesystem::perms::others_exec,
+                std::filesystem::perm_options::add, ec);
+        }
+    }
+};
+
+size_t write_to_extractor(char *data, size_t size, size_t nmemb, TarGz *tar) {
+    // Anything short of the full chunk makes curl abort the transfer
+    return tar->feed(data, size * nmemb) ? size * nmemb : 0;
+}
+
+// Downloads `url` into `dest` (which must not exist yet), checking the
+// archive against `sha256`. On failure nothing is left at `dest`, and the
+// reason comes back.
+std::optional<std::string> fetch(const std::string &url,
+                                 const std::string &sha256, unsigned strip,
+                                 const std::filesystem::path &dest) {
+    trace::Scope span("fetch " + url, "network");
+    // Extract next to `dest` and only move it there once it's verified
+    auto partial = dest;
+    partial += ".partial";
+    std::error_code ec;
+    std::filesystem::remove_all(partial, ec);
+    std::filesystem::create_directories(partial, ec);
+
+    std::optional<std::string> error;
+    {
+        TarGz tar(partial, strip);
+        CURL *curl = curl_easy_init();
+        if (!curl)
+            return "couldn't initialise curl";
+        char curl_error[CURL_ERROR_SIZE] = "";
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_error);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_to_extractor);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &tar);
+        auto res = curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+
+        if (!tar.error().empty())
+            error = tar.error();
+        else if (res != CURLE_OK)
+            error = curl_error[0] ? curl_error : curl_easy_strerror(res);
+        else if (!tar.finish())
+            error = tar.error();
+        else if (auto digest = tar.digest(); digest != sha256)
+            error = std::format("sha256 is {}, the index says {}", digest,
+                                sha256);
+    }
+    if (!error.has_value()) {
+        std::filesystem::rename(partial, dest, ec);
+        if (ec)
+            error = std::format("couldn't move it into place: {}", ec.message());
+    }
+    if (error.has_value())
+        std::filesystem::remove_all(partial, ec);
+    return error;
+}
+} // namespace archive
+
+// One copy of every synced dep per machine, in ~/.dreamcpp/store. Files are
+// stored once by content (files/ab/<sha256>), and each dep + commit is a
+// listing of them (trees/<dep>/<commit>). Projects get their build/deps
+// reflinked or hardlinked out of it, so a dep that any project on this
+// machine already has costs no network and next to no disk.
+namespace store {
+struct Entry {
+    char kind;        // 'f'ile, 'x' (executable file), 'l'ink or 'd'ir
+    std::string data; // sha256 for files, target for links
+    std::string path; // Relative to the dep's root
+};
+
+using Tree = std::vector<Entry>;
+
+std::filesystem::path root() { return dreamcpp_home() / "store"; }
+
+std::filesystem::path blob_path(const Entry &entry) {
+    // The exec bit is shared by every hardlink, so it's part of the name
+    return root() / "files" / entry.data.substr(0, 2) /
+           (entry.kind == 'x' ? entry.data + "x" : entry.data);
+}
+
+std::filesystem::path tree_path(const std::string &dep_name,
+                                const std::string &key) {
+    return root() / "trees" / dep_name / key;
+}
+
+// A fresh dir to fetch into, on the store's filesystem so ingesting it is
+// just renames
+std::filesystem::path scratch_dir(const std::string &dep_name) {
+    static std::atomic<unsigned> next = 0;
+    auto dir = root() / "tmp" /
+               std::format("{}-{}-{}", dep_name, getpid(), next++);
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+std::optional<Tree> load(const std::string &dep_name, const std::string &key) {
+    std::ifstream file(tree_path(dep_name, key));
+    if (!file.is_open())
+        return std::nullopt;
+    Tree tree;
+    std::string line;
+    while (std::getline(file, line)) {
+        auto first = line.find('\t');
+        auto second = line.find('\t', first + 1);
+        if (first != 1 || second == std::string::npos)
+            return std::nullopt;
+        tree.push_back({line[0], line.substr(2, second - 2),
+                        line.substr(second + 1)});
+    }
+    return tree;
+}
+
+// Moves everything under `dir` (but its .git) into the store as
+// trees/<dep_name>/<key>. Returns why it couldn't, if it couldn't. With
+// `recheck`, blobs already in the store are re-hashed and replaced if bad.
+std::optional<std::string> ingest(const std::filesystem::path &dir,
+                                  const std::string &dep_name,
+                                  const std::string &key,
+                                  bool recheck = false) {
+    trace::Scope span("store " + dep_name, "dependency");
+    Tree tree;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+         it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+        auto relative = it->path().lexically_relative(dir).generic_string();
+        if (it->path().filename() == ".git") {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (relative.find_first_of("\t\n") != std::string::npos)
+            return std::format("'{}' can't be listed in the store", relative);
+
+        if (it->is_symlink(ec)) {
+            tree.push_back(
+                {'l', std::filesystem::read_symlink(it->path(), ec).string(),
+                 relative});
+        } else if (it->is_directory(ec)) {
+            tree.push_back({'d', "-", relative});
+        } else if (it->is_regular_file(ec)) {
+            auto digest = sha256_file(it->path().string());
+            if (!digest.has_value())
+                return std::format("couldn't read '{}'", relative);
+            auto perms = it->status(ec).permissions();
+            bool executable = (perms & std::filesystem::perms::owner_exec) !=
+                              std::filesystem::perms::none;
+            Entry entry{executable ? 'x' : 'f', *digest, relative};
+
+            // Blobs are read-only, since projects may hold hardlinks to them
+            auto blob = blob_path(entry);
+            if (recheck && std::filesystem::exists(blob) &&
+                sha256_file(blob.string()) != *digest)
+                std::filesystem::remove(blob, ec);
+            if (!std::filesystem::exists(blob)) {
+                std::filesystem::create_directories(blob.parent_path(), ec);
+                chmod(it->path().c_str(), executable ? 0555 : 0444);
+                std::filesystem::rename(it->path(), blob, ec);
+                if (ec)
+                    return std::format("couldn't store '{}': {}", relative,
+                                       ec.message());
+            }
+            tree.push_back(std::move(entry));
+        }
+    }
+    if (ec)
+        return ec.message();
+
+    // Written aside and renamed, so a tree is either complete or not there
+    auto fp = tree_path(dep_name, key);
+    std::filesystem::create_directories(fp.parent_path(), ec);
+    auto partial = fp;
+    partial += std::format(".{}.partial", getpid());
+    {
+        std::ofstream file(partial);
+        for (const auto &entry : tree)
+            file << entry.kind << '\t' << entry.data << '\t' << entry.path
+                 << '\n';
+        if (!file.good())
+            return std::format("couldn't write '{}'", partial.string());
+    }
+    std::filesystem::rename(partial, fp, ec);
+    if (ec)
+        return ec.message();
+    return std::nullopt;
+}
+
+// Projects hold hardlinks to blobs, so writing to a file in build/deps
+// writes to the store. Re-hashes every blob `tree` uses and evicts the ones
+// that don't match their name, along with the tree. True if all of them did.
+bool verify(const Tree &tree, const std::string &dep_name,
+            const std::string &key) {
+    bool intact = true;
+    for (const auto &entry : tree) {
+        if (entry.kind != 'f' && entry.kind != 'x')
+            continue;
+        auto blob = blob_path(entry);
+        if (sha256_file(blob.string()) == entry.data)
+            continue;
+        std::error_code ec;
+        std::filesystem::remove(blob, ec);
+        intact = false;
+    }
+    if (!intact) {
+        std::error_code ec;
+        std::filesystem::remove(tree_path(dep_name, key), ec);
+    }
+    return intact;
+}
+
+// A copy-on-write clone where the filesystem can do those (btrfs, xfs), a
+// hardlink where it can't, and a plain copy across filesystems
+bool place(const std::filesystem::path &blob, const std::filesystem::path &dest,
+           bool executable) {
+    static std::atomic<bool> reflinks = true;
+    if (reflinks) {
+        int in = open(blob.c_str(), O_RDONLY | O_CLOEXEC);
+        int out = open(dest.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                       executable ? 0755 : 0644);
+        bool cloned = in >= 0 && out >= 0 && ioctl(out, FICLONE, in) == 0;
+        if (!cloned && (errno == EOPNOTSUPP || errno == ENOTTY ||
+                        errno == EXDEV || errno == EINVAL))
+            reflinks = false; // Not going to work for the next one either
+        if (in >= 0)
+            close(in);
+        if (out >= 0)
+            close(out);
+        if (cloned)
+            return true;
+        if (out >= 0)
+            unlink(dest.c_str());
+    }
+    if (link(blob.c_str(), dest.c_str()) == 0)
+        return true;
+    std::error_code ec;
+    std::filesystem::copy_file(blob, dest, ec);
+    return !ec && chmod(dest.c_str(), executable ? 0755 : 0644) == 0;
+}
+
+// Name -> digest (sha256, or "link:<target>") for each of a dep's files,
+// hashed the way dreamcpp.lock records them
+std::string hash_listing(std::vector<std::pair<std::string, std::string>> listing) {
+    std::sort(listing.begin(), listing.end());
+    Sha256 hasher;
+    for (const auto &[name, digest] : listing) {
+        hasher.update(name).update(std::string_view("\0", 1)).update(digest);
+        hasher.update("\n");
+    }
+    return hasher.hex();
+}
+
+// Where `entry` goes in a project. A header-only dep's include/<name> tree
+// goes to build/includes/<name>, the rest (of anything) to build/deps/<name>.
+std::pair<unsigned, std::string> destination(const Entry &entry,
+                                             const std::string &dep_name,
+                                             bool header_only) {
+    auto include_dir = std::format("include/{}/", dep_name);
+    if (header_only && entry.path.starts_with(include_dir))
+        return {1, entry.path.substr(include_dir.size())};
+    return {0, entry.path};
+}
+
+// What dependency::hash_dependency_tree() would say about the materialized
+// tree, without reading any of it back
+std::string content_hash(const Tree &tree, const std::string &dep_name,
+                         bool header_only) {
+    std::vector<std::pair<std::string, std::string>> listing;
+    for (const auto &entry : tree) {
+        if (entry.kind == 'd')
+            continue;
+        auto [root, path] = destination(entry, dep_name, header_only);
+        listing.emplace_back(std::format("{}:{}", root, path),
+                             entry.kind == 'l' ? "link:" + entry.data
+                                               : entry.data);
+    }
+    return hash_listing(std::move(listing));
+}
+
+// Recreates `tree` as `dep_path` (and `include_path`), which must not exist
+std::optional<std::string> materialize(const Tree &tree,
+                                       const std::string &dep_name,
+                                       bool header_only,
+                                       const std::filesystem::path &dep_path,
+                                       const std::filesystem::path &include_path) {
+    trace::Scope span("materialize " + dep_name, "dependency");
+    const std::filesystem::path roots[] = {dep_path, include_path};
+    std::error_code ec;
+    std::filesystem::create_directories(dep_path, ec);
+    if (header_only)
+        std::filesystem::create_directories(include_path, ec);
+    for (const auto &entry : tree) {
+        auto [root, path] = destination(entry, dep_name, header_only);
+        auto dest = roots[root] / path;
+        if (entry.kind == 'd') {
+            std::filesystem::create_directories(dest, ec);
+            continue;
+        }
+        std::filesystem::create_directories(dest.parent_path(), ec);
+        if (entry.kind == 'l') {
+            std::filesystem::create_symlink(entry.data, dest, ec);
+            if (ec)
+                return std::format("couldn't link '{}': {}", path, ec.message());
+        } else if (!place(blob_path(entry), dest, entry.kind == 'x')) {
+            return std::format("'{}' is missing from the store", entry.path);
+        }
+    }
+    return std::nullopt;
+}
+} // namespace store
+
+// The remote index can also be served sparse (DREAMCPP_INDEX_URL set to
+// "sparse+<base url>"): one small file per package, so resolving a few deps
+// never means downloading and parsing the whole index. Each file holds the
+// package's entry just like the full index would, and aliases get a copy.
+namespace sparse_index {
+const std::string SCHEME = "sparse+";
+
+// <ab>/<cd>/<name>.toml, ab and cd from a hash of the name so no directory
+// ends up with too many files in it
+std::string entry_path(const std::string &name) {
+    auto hash = std::format("{:016x}", fnv1a(name));
+    return std::format("{}/{}/{}.toml", hash.substr(0, 2), hash.substr(2, 2),
+                       name);
+}
+
+// Splits a full index into that layout under `dir`
+bool write(const std::string &index_fp, const std::filesystem::path &dir) {
+    try {
+        toml::table index = toml::parse_file(index_fp);
+        size_t files = 0;
+        for (const auto &[key, value] : index) {
+            auto entry = value.as_table();
+            if (!entry)
+                continue;
+            std::vector<std::string> names = {std::string(key)};
+            if (auto aliases = (*entry)["aliases"].as_array()) {
+                for (const auto &alias : *aliases) {
+                    if (auto alias_str = alias.value<std::string>())
+                        names.push_back(*alias_str);
+                }
+            }
+            toml::table file_tbl;
+            file_tbl.insert(key, *entry);
+            for (const auto &name : names) {
+                auto fp = dir / entry_path(name);
+                std::filesystem::create_directories(fp.parent_path());
+                std::ofstream file(fp);
+                file << file_tbl << "\n";
+                if (!file.good()) {
+                    spdlog::error("[🚀] ❌ Couldn't write '{}'", fp.string());
+                    return false;
+                }
+                ++files;
+            }
+        }
+        spdlog::info("[🚀] ✅ Wrote {} entries to {}", files, dir.string());
+        return true;
+    } catch (const toml::parse_error &err) {
+        spdlog::error("[📖] ❌ Couldn't parse '{}': {}", index_fp,
+                      err.description());
+        return false;
+    } catch (const std::exception &e) {
+        spdlog::error("[🚀] ❌ Couldn't write the sparse index: {}", e.what());
+        return false;
+    }
+}
+
+// The entry for `name` out of one of those files (by its name or an alias)
+std::optional<DepIndex> parse_entry(const std::string &body,
+                                    const std::string &name) {
+    auto entries = parse_repository_index(body);
+    if (!entries.has_value())
+        return std::nullopt;
+    for (const auto &[key, dep] : *entries) {
+        if (key == name || std::find(dep.aliases.begin(), dep.aliases.end(),
+                                     name) != dep.aliases.end())
+            return dep;
+    }
+    return std::nullopt;
+}
+
+struct Transfer {
+    std::string name;
+    std::filesystem::path cached; // Last copy of this entry, and .meta next to it
+    CURL *easy = nullptr;
+    curl_slist *header_list = nullptr;
+    std::string body;
+    std::map<std::string, std::string> headers;
+};
+
+// Fetches the entries for `names`, and for whatever they depend on, all on
+// one curl multi handle. Over HTTP/2 every request shares one connection;
+// dependencies are requested as soon as the entry naming them arrives.
+// Entries are cached (and revalidated with ETag/Last-Modified) like the full
+// index, and the cached copy stands in when the server can't be reached.
+std::map<std::string, DepIndex> fetch(const std::string &base_url,
+                                      const std::vector<std::string> &names) {
+    trace::Scope span("fetch sparse index", "network");
+    auto base = base_url.ends_with('/') ? base_url : base_url + "/";
+    auto cache_dir = dreamcpp_home() / "cache" / "index" / "sparse" /
+                     std::format("{:016x}", fnv1a(base));
+
+    std::map<std::string, DepIndex> found;
+    std::set<std::string> requested;
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    CURLM *multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    size_t active = 0;
+
+    auto read_file = [](const std::filesystem::path &fp)
+        -> std::optional<std::string> {
+        std::ifstream file(fp, std::ios::binary);
+        if (!file.is_open())
+            return std::nullopt;
+        return std::string((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    };
+
+    auto start = [&](const std::string &name) {
+        if (!valid_dep_name(name) || !requested.insert(name).second)
+            return;
+        auto transfer = std::make_unique<Transfer>();
+        transfer->name = name;
+        transfer->cached = cache_dir / entry_path(name);
+
+        // Names can have anything in them ("toml++"), so escape that part
+        auto path = entry_path(name);
+        auto slash = path.rfind('/');
+        char *escaped = curl_easy_escape(nullptr, path.c_str() + slash + 1, 0);
+        auto url = base + path.substr(0, slash + 1) + escaped;
+        curl_free(escaped);
+
+        if (std::filesystem::exists(transfer->cached)) {
+            try {
+                auto meta_fp = transfer->cached;
+                meta_fp += ".meta";
+                auto meta = toml::parse_file(meta_fp.string());
+                if (auto etag = meta["etag"].value<std::string>())
+                    transfer->header_list = curl_slist_append(
+                        transfer->header_list, ("If-None-Match: " + *etag).c_str());
+                if (auto modified = meta["last_modified"].value<std::string>())
+                    transfer->header_list = curl_slist_append(
+                        transfer->header_list,
+                        ("If-Modified-Since: " + *modified).c_str());
+            } catch (const std::exception &) {
+                // No usable metadata, do a plain fetch
+            }
+        }
+
+        CURL *easy = curl_easy_init();
+        transfer->easy = easy;
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->body);
+        curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, headerCallback);
+        curl_easy_setopt(easy, CURLOPT_HEADERDATA, &transfer->headers);
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->header_list);
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        // Wait for the connection already being set up rather than opening
+        // another, in case it turns out to be one that can multiplex
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+        curl_multi_add_handle(multi, easy);
+        transfers.push_back(std::move(transfer));
+        ++active;
+    };
+
+    auto finish = [&](Transfer &transfer, CURLcode result) {
+        long status = 0;
+        if (result == CURLE_OK)
+            curl_easy_getinfo(transfer.easy, CURLINFO_RESPONSE_CODE, &status);
+        std::optional<std::string> body;
+        if (status == 200) {
+            body = transfer.body;
+            std::error_code ec;
+            std::filesystem::create_directories(transfer.cached.parent_path(), ec);
+            auto tmp = transfer.cached;
+            tmp += std::format(".tmp{}", getpid());
+            std::ofstream(tmp, std::ios::binary) << transfer.body;
+            std::filesystem::rename(tmp, transfer.cached, ec);
+            toml::table meta;
+            if (auto etag = get_or_nullopt(transfer.headers, "etag"))
+                meta.insert("etag", *etag);
+            if (auto modified = get_or_nullopt(transfer.headers, "last-modified"))
+                meta.insert("last_modified", *modified);
+            auto meta_fp = transfer.cached;
+            meta_fp += ".meta";
+            std::ofstream(meta_fp) << meta;
+        } else if (status == 404 || status == 410) {
+            return; // Not in the index
+        } else {
+            body = read_file(transfer.cached);
+            if (status != 304) {
+                spdlog::warn("[🚀] ⚠️ Failed to fetch index entry '{}' ({}){}",
+                             transfer.name,
+                             result == CURLE_OK
+                                 ? std::format("HTTP {}", status)
+                                 : std::string(curl_easy_strerror(result)),
+                             body ? ", using cached copy" : "");
+            }
+        }
+        if (!body.has_value())
+            return;
+        if (auto dep = parse_entry(*body, transfer.name)) {
+            for (const auto &dependency : dep->dependencies) {
+                start(dependency);
+            }
+            found[transfer.name] = std::move(*dep);
+        }
+    };
+
+    for (const auto &name : names) {
+        start(name);
+    }
+    while (active > 0) {
+        int running = 0;
+        if (curl_multi_perform(multi, &running) != CURLM_OK)
+            break;
+        int queued = 0;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            Transfer *transfer = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            auto result = msg->data.result;
+            curl_multi_remove_handle(multi, transfer->easy);
+            --active;
+            finish(*transfer, result);
+        }
+        if (active > 0)
+            curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    for (auto &transfer : transfers) {
+        if (active > 0)
+            curl_multi_remove_handle(multi, transfer->easy);
+        curl_easy_cleanup(transfer->easy);
+        curl_slist_free_all(transfer->header_list);
+    }
+    curl_multi_cleanup(multi);
+    return found;
+}
+} // namespace sparse_index
+
+namespace dependency {
+enum class FetchMode {
+    Shallow,  // Only the pinned commit (--depth=1)
+    Blobless, // All commits, but file contents on demand (--filter=blob:none)
+    Full,     // Everything, like a plain `git clone`
+};
+
+std::optional<FetchMode> parse_fetch_mode(const std::string &name) {
+    if (name == "shallow")
+        return FetchMode::Shallow;
+    if (name == "blobless")
+        return FetchMode::Blobless;
+    if (name == "full")
+        return FetchMode::Full;
+    return std::nullopt;
+}
+
+struct SyncOptions {
+    unsigned jobs = 8; // Clones are mostly waiting on the network, not the CPU
+    FetchMode fetch = FetchMode::Shallow;
+    bool update = false; // Accept locked commits whose contents changed
+};
+
+bool validate_project_environment() {
+    if (!std::filesystem::exists("dreamcpp.toml")) {
+        spdlog::error("[🚀] ❌ This... isn't a 🌌++ project.");
+        return false;
+    }
+
+    if (process::run({"git", "--version"}).exit_code != 0) {
+        spdlog::error("[🚀] ❌ You don't have git installed. :P");
+        return false;
+    }
+
+    return true;
+}
+
+// Every local index, in search order: ~/.dreamcpp/index first, then
+// ../index, each sorted by file name. Loaded once per process.
+const std::vector<std::unique_ptr<local_index::Table>> &local_indexes() {
+    static std::once_flag once;
+    static std::vector<std::unique_ptr<local_index::Table>> tables;
+    std::call_once(once, []() {
+        std::vector<std::string> search_paths = {
+            (dreamcpp_home() / "index").string(), "../index"};
+        // A workspace syncs from its root, where the members' ../index is
+        if (std::filesystem::exists(WORKSPACE_MANIFEST))
+            search_paths.push_back("index");
+
+        for (const auto &path : search_paths) {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(path, ec))
+                continue;
+            std::vector<std::filesystem::path> files;
+            for (const auto &entry :
+                 std::filesystem::directory_iterator(path, ec)) {
+                if (entry.path().extension() == ".toml")
+                    files.push_back(entry.path());
+            }
+            std::sort(files.begin(), files.end());
+            for (const auto &file : files) {
+                if (auto table = local_index::open_index(file)) {
+                    tables.push_back(std::move(table));
+                } else {
+                    spdlog::warn("[🚀] ⚠️ Skipping unreadable index '{}'",
+                                 file.string());
+                }
+            }
+        }
+    });
+    return tables;
+}
+
+std::optional<DepIndex> search_local_indexes(const std::string &dep_name) {
+    for (const auto &table : local_indexes()) {
+        if (auto dep = table->find(dep_name)) {
+            return dep;
+        }
+    }
+    return std::nullopt;
+}
+
+std::string remote_index_url() {
+    // Overridable so mirrors (or a local test server) can stand in for GitHub
+    if (const char *url = getenv("DREAMCPP_INDEX_URL"))
+        return url;
+    return "https://raw.githubusercontent.com/frinkifail/dreamcpp/refs/heads/"
+           "main/index/dcpp%3Acore.toml";
+}
+
+// Fetches the remote index, revalidating the copy in ~/.dreamcpp/cache/index
+// with ETag/Last-Modified. Falls back to that copy when offline.
+std::optional<std::string> fetch_remote_index() {
+    const std::string index_url = remote_index_url();
+    auto cache_dir = dreamcpp_home() / "cache" / "index";
+    auto body_path = cache_dir / "dcpp-core.toml";
+    auto meta_path = cache_dir / "dcpp-core.meta.toml";
+
+    auto read_cached = [&]() -> std::optional<std::string> {
+        std::ifstream file(body_path);
+        if (!file.is_open())
+            return std::nullopt;
+        return std::string((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    };
+
+    std::vector<std::string> request_headers;
+    if (std::filesystem::exists(body_path)) {
+        try {
+            auto meta = toml::parse_file(meta_path.string());
+            if (meta["url"].value_or("") == index_url) {
+                if (auto etag = meta["etag"].value<std::string>())
+                    request_headers.push_back("If-None-Match: " + *etag);
+                if (auto modified = meta["last_modified"].value<std::string>())
+                    request_headers.push_back("If-Modified-Since: " + *modified);
+            }
+        } catch (const std::exception &) {
+            // No usable metadata, do a plain fetch
+        }
+    }
+
+    auto response = fetchURL(index_url, request_headers);
+    if (response.status == 304) {
+        if (auto cached = read_cached())
+            return cached;
+        response = fetchURL(index_url); // Cached copy vanished under us
+    }
+
+    if (response.status != 200) {
+        if (auto cached = read_cached()) {
+            spdlog::warn("[🚀] ⚠️ Failed to fetch remote index (HTTP {}), "
+                         "using cached copy",
+                         response.status);
+            return cached;
+        }
+        spdlog::warn("[🚀] ⚠️ Failed to fetch remote index (HTTP {})",
+                     response.status);
+        return std::nullopt;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    toml::table meta;
+    meta.insert("url", index_url);
+    if (auto etag = get_or_nullopt(response.headers, "etag"))
+        meta.insert("etag", *etag);
+    if (auto modified = get_or_nullopt(response.headers, "last-modified"))
+        meta.insert("last_modified", *modified);
+
+    auto tmp = body_path;
+    tmp += std::format(".tmp{}", getpid());
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        file << response.body;
+    }
+    std::filesystem::rename(tmp, body_path, ec);
+    if (!ec) {
+        std::ofstream file(meta_path);
+        file << meta;
+    }
+    return response.body;
+}
+
+// The parsed remote index, fetched at most once per process no matter how
+// many deps (or sync threads) ask for it
+const std::optional<std::map<std::string, DepIndex>> &remote_index() {
+    static std::once_flag once;
+    static std::optional<std::map<std::string, DepIndex>> index;
+    std::call_once(once, []() {
+        if (auto body = fetch_remote_index()) {
+            index = parse_repository_index(*body);
+        }
+    });
+    return index;
+}
+
+// Entries fetched so far from a sparse remote index
+std::mutex sparse_mutex;
+std::map<std::string, DepIndex> sparse_entries;
+std::set<std::string> sparse_requested;
+
+// Fetches (together) whichever of `dep_names` a sparse remote index hasn't
+// been asked about yet. Does nothing for a full one, that's fetched whole.
+void prefetch_remote(const std::vector<std::string> &dep_names) {
+    auto url = remote_index_url();
+    if (!url.starts_with(sparse_index::SCHEME))
+        return;
+    std::lock_guard lock(sparse_mutex);
+    std::vector<std::string> wanted;
+    for (const auto &name : dep_names) {
+        if (sparse_requested.insert(name).second)
+            wanted.push_back(name);
+    }
+    if (wanted.empty())
+        return;
+    auto found = sparse_index::fetch(
+        url.substr(sparse_index::SCHEME.size()), wanted);
+    for (auto &[name, dep] : found) {
+        sparse_requested.insert(name);
+        sparse_entries.emplace(name, std::move(dep));
+    }
+}
+
+std::optional<DepIndex> search_remote_index(const std::string &dep_name) {
+    if (remote_index_url().starts_with(sparse_index::SCHEME)) {
+        prefetch_remote({dep_name});
+        std::lock_guard lock(sparse_mutex);
+        return get_or_nullopt(sparse_entries, dep_name);
+    }
+
+    const auto &index = remote_index();
+    if (!index.has_value()) {
+        return std::nullopt;
+    }
+
+    // Direct lookup first
+    auto dep = get_or_nullopt(index.value(), dep_name);
+    if (dep.has_value()) {
+        return dep;
+    }
+
+    // Search aliases
+    for (const auto &[key, value] : index.value()) {
+        auto it =
+            std::find(value.aliases.begin(), value.aliases.end(), dep_name);
+        if (it != value.aliases.end()) {
+            return value;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<DepIndex> resolve_dependency_url(const std::string &dep_name) {
+    // Try local indexes first
+    if (auto local_result = search_local_indexes(dep_name)) {
+        return local_result;
+    }
+
+    // Fall back to remote index
+    if (auto remote_result = search_remote_index(dep_name)) {
+        return remote_result;
+    }
+
+    return std::nullopt;
+}
+
+bool save_config(const AppConfig &config,
+                 const std::string &config_path = "dreamcpp.toml") {
+    // Actually implement this using the existing functions
+    auto serialized = serialise_config(config);
+    return sync_config(serialized, config_path);
+}
+
+bool add(const std::string &dep_name) {
+    spdlog::info("[🚀] Adding dependency: {}", dep_name);
+    if (!valid_dep_name(dep_name)) {
+        spdlog::error("[🚀] ❌ '{}' isn't a valid dependency name", dep_name);
+        return false;
+    }
+
+    if (!validate_project_environment()) {
+        return false;
+    }
+
+    // Parse current config
+    auto app = parse_config_file(
+        "dreamcpp.toml", std::filesystem::current_path().filename().string());
+    if (!app.has_value()) {
+        return false;
+    }
+
+    // Check if dependency already exists
+    for (const auto &dep : app->deps) {
+        if (dep.name == dep_name) {
+            spdlog::warn("[🚀] ⚠️  Dependency '{}' already exists", dep_name);
+            return true;
+        }
+    }
+
+    // Resolve the dependency URL to make sure it exists
+    auto repo_url = resolve_dependency_url(dep_name);
+    if (!repo_url.has_value()) {
+        spdlog::error("[🚀] ❌ Dependency not found: {}", dep_name);
+        spdlog::info(
+            "[🚀] ❌ Checked: [~/.dreamcpp/index, ../index, github repo]");
+        return false;
+    }
+
+    // Add to deps list (don't store the git URL)
+    Dependency new_dep;
+    new_dep.name = dep_name;
+    new_dep.version = "latest"; // Default version
+    // Don't set git field - it will be resolved dynamically
+
+    app->deps.push_back(new_dep);
+
+    // Save updated config
+    if (!save_config(app.value())) {
+        return false;
+    }
+
+    spdlog::info("[🚀] ✅ Added dependency '{}' to project", dep_name);
+    spdlog::info("[🚀] 💡 Run 'dreamcpp sync' to install dependencies");
+    return true;
+}
+
+// Git commands that fetch `index` into `path`. Shallow/blobless fetches skip
+// history, and `sparse_dir` (header-only deps) limits the checkout to the
+// include tree so only those blobs are ever downloaded. Values from the
+// index all go after "--", where git can't take them for options.
+std::vector<std::vector<std::string>>
+fetch_commands(const DepIndex &index, const std::string &path, FetchMode mode,
+               const std::optional<std::string> &sparse_dir) {
+    bool sparse = sparse_dir.has_value() && mode != FetchMode::Full;
+    std::vector<std::string> history_flags;
+    if (mode == FetchMode::Shallow)
+        history_flags.push_back("--depth=1");
+    if (mode == FetchMode::Blobless || sparse)
+        history_flags.push_back("--filter=blob:none");
+
+    std::vector<std::vector<std::string>> cmds;
+    if (index.rev.has_value()) {
+        // `clone --branch` can't take a commit, so fetch exactly that one
+        cmds.push_back({"git", "init", "-q", "--", path});
+        cmds.push_back(
+            {"git", "-C", path, "remote", "add", "--", "origin", index.git});
+        if (sparse)
+            cmds.push_back({"git", "-C", path, "sparse-checkout", "set", *sparse_dir});
+        std::vector<std::string> fetch = {"git", "-C", path, "fetch", "-q"};
+        fetch.insert(fetch.end(), history_flags.begin(), history_flags.end());
+        fetch.insert(fetch.end(), {"--", "origin", *index.rev});
+        cmds.push_back(fetch);
+        cmds.push_back({"git", "-C", path, "checkout", "-q", "FETCH_HEAD"});
+        return cmds;
+    }
+
+    std::vector<std::string> clone = {"git", "clone", "-q"};
+    clone.insert(clone.end(), history_flags.begin(), history_flags.end());
+    if (index.branch.has_value())
+        clone.insert(clone.end(), {"--branch", *index.branch});
+    if (sparse)
+        clone.push_back("--sparse");
+    clone.insert(clone.end(), {"--", index.git, path});
+    cmds.push_back(clone);
+    if (sparse)
+        cmds.push_back({"git", "-C", path, "sparse-checkout", "set", *sparse_dir});
+    return cmds;
+}
+
+// dreamcpp.lock pins every synced dep to the exact commit (and content) it
+// was resolved to, so later syncs are reproducible and can skip the index
+struct LockEntry {
+    std::string git;
+    std::string commit;  // The archive's sha256 for archive deps
+    std::string content; // hash_dependency_tree() at sync time
+    bool header_only = false;
+    std::string archive = ""; // URL, if it was fetched as one
+    uint32_t strip = 1;       // And DepIndex::strip for it
+    std::string required_by = ""; // The dep whose index entry pulled it in
+};
+
+using Lockfile = std::map<std::string, LockEntry>;
+
+const std::string LOCKFILE_PATH = "dreamcpp.lock";
+
+std::optional<Lockfile> load_lockfile(const std::string &fp = LOCKFILE_PATH) {
+    if (!std::filesystem::exists(fp))
+        return std::nullopt;
+    try {
+        toml::table tbl = toml::parse_file(fp);
+        Lockfile lock;
+        for (const auto &[name, value] : tbl) {
+            if (auto dep = value.as_table()) {
+                LockEntry entry;
+                entry.git = (*dep)["git"].value_or("");
+                entry.commit = (*dep)["commit"].value_or("");
+                entry.content = (*dep)["content"].value_or("");
+                entry.header_only = (*dep)["header"].value_or(false);
+                entry.archive = (*dep)["archive"].value_or("");
+                entry.strip = (uint32_t)(*dep)["strip"].value_or(int64_t{1});
+                entry.required_by = (*dep)["required_by"].value_or("");
+                if (!valid_dep_name(name.str()) ||
+                    (!entry.required_by.empty() &&
+                     !valid_dep_name(entry.required_by))) {
+                    spdlog::warn("[🔒] ⚠️ Ignoring '{}' in {}, it isn't a "
+                                 "valid dependency name",
+                                 name.str(), fp);
+                    continue;
+                }
+                if (option_like(entry.git) || option_like(entry.commit)) {
+                    spdlog::warn("[🔒] ⚠️ Ignoring '{}' in {}, its git or "
+                                 "commit starts with '-'",
+                                 name.str(), fp);
+                    continue;
+                }
+                lock[std::string(name)] = entry;
+            }
+        }
+        return lock;
+    } catch (const toml::parse_error &err) {
+        spdlog::warn("[🔒] ⚠️ Ignoring unreadable '{}': {}", fp,
+                     err.description());
+        return std::nullopt;
+    }
+}
+
+bool save_lockfile(const Lockfile &lock,
+                   const std::string &fp = LOCKFILE_PATH) {
+    toml::table tbl;
+    tbl.insert("version", 1);
+    for (const auto &[name, entry] : lock) {
+        toml::table dep;
+        dep.insert("git", entry.git);
+        dep.insert("commit", entry.commit);
+        dep.insert("content", entry.content);
+        dep.insert("header", entry.header_only);
+        if (!entry.archive.empty()) {
+            dep.insert("archive", entry.archive);
+            dep.insert("strip", (int64_t)entry.strip);
+        }
+        if (!entry.required_by.empty())
+            dep.insert("required_by", entry.required_by);
+        tbl.insert(name, dep);
+    }
+    std::ofstream file(fp);
+    if (!file.is_open()) {
+        spdlog::error("[🔒] ❌ Failed to write '{}'.", fp);
+        return false;
+    }
+    file << "# Generated by dreamcpp sync, don't edit by hand\n" << tbl;
+    return true;
+}
+
+// SHA-256 over every file a dep materialized (its clone minus .git, plus
+// its moved include tree), so tampered or half-synced deps are noticed
+std::string hash_dependency_tree(const std::string &dep_name) {
+    const std::vector<std::filesystem::path> roots = {
+        std::format("build/deps/{}", dep_name),
+        std::format("build/includes/{}", dep_name)};
+
+    std::vector<std::pair<std::string, std::string>> listing;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(roots[i], ec))
+            continue;
+        for (auto it = std::filesystem::recursive_directory_iterator(roots[i], ec);
+             it != std::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (it->path().filename() == ".git") {
+                it.disable_recursion_pending();
+                continue;
+            }
+            auto relative = it->path().lexically_relative(roots[i]);
+            if (relative == REVISION_STAMP)
+                continue;
+            auto name = std::format("{}:{}", i, relative.generic_string());
+            if (it->is_symlink(ec)) {
+                listing.emplace_back(
+                    name, "link:" + std::filesystem::read_symlink(it->path(), ec)
+                                        .string());
+            } else if (it->is_regular_file(ec)) {
+                listing.emplace_back(
+                    name, sha256_file(it->path().string()).value_or(""));
+            }
+        }
+    }
+    return store::hash_listing(std::move(listing));
+}
+
+bool matches_lock(const std::string &dep_name, const LockEntry &entry) {
+    auto dep_path = std::format("build/deps/{}", dep_name);
+    return std::filesystem::is_directory(dep_path) &&
+           git_head_revision(dep_path) == entry.commit &&
+           hash_dependency_tree(dep_name) == entry.content;
+}
+
+// The commit `index` points at right now, asked of the remote without
+// fetching anything, so the store can be checked before cloning
+std::optional<std::string> remote_revision(const DepIndex &index) {
+    auto is_commit = [](const std::string &rev) {
+        return rev.size() == 40 &&
+               rev.find_first_not_of("0123456789abcdef") == std::string::npos;
+    };
+    if (index.rev.has_value() && is_commit(*index.rev))
+        return index.rev;
+    auto ref = index.rev.value_or(index.branch.value_or("HEAD"));
+    auto result =
+        process::run({"git", "ls-remote", "--", index.git, ref, ref + "^{}"});
+    if (result.exit_code != 0)
+        return std::nullopt;
+
+    // An annotated tag's own line is the tag object, "<tag>^{}" is its commit
+    std::optional<std::string> revision;
+    std::istringstream lines(result.output);
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto hash = line.substr(0, line.find('\t'));
+        if (!is_commit(hash))
+            continue;
+        if (line.ends_with("^{}"))
+            return hash;
+        if (!revision.has_value())
+            revision = hash;
+    }
+    return revision;
+}
+
+// Fetches `repo_index` into `path` (which must not exist yet), either as its
+// archive or with git
+bool fetch_dependency(const std::string &dep_name, const DepIndex &repo_index,
+                      bool use_archive, FetchMode mode,
+                      const std::filesystem::path &path, JobLog &log) {
+    if (use_archive) {
+        log.info("[🚀] 📦 Downloading '{}'...", dep_name);
+        if (auto error = archive::fetch(*repo_index.archive, *repo_index.sha256,
+                                        repo_index.strip, path)) {
+            log.error("[🚀] ❌ Failed to download {}: {}", dep_name, *error);
+            return false;
+        }
+        return true;
+    }
+
+    // The branch goes in as `--branch <it>`, ahead of the "--", so it has to
+    // be checked here like the rest
+    if (option_like(repo_index.git) ||
+        option_like(repo_index.rev.value_or("")) ||
+        option_like(repo_index.branch.value_or(""))) {
+        log.error("[🚀] ❌ '{}' has a git, rev or branch starting with '-'",
+                  dep_name);
+        return false;
+    }
+    log.info("[🚀] 📦 Cloning '{}'...", dep_name);
+    std::string include_dir = std::format("include/{}", dep_name);
+    auto fetch_cmds = fetch_commands(
+        repo_index, path.string(), mode,
+        repo_index.header_only ? std::optional(include_dir) : std::nullopt);
+
+    for (const auto &cmd : fetch_cmds) {
+        auto result = process::run(cmd);
+        if (result.exit_code != 0) {
+            log.error("[🚀] ❌ Failed to clone dependency: {}", dep_name);
+            log.error("[🚀] ❌ Git output: {}", result.output);
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec); // Don't leave half a clone
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes build/deps/<dep_name> match its lock entry (if any), fetching it when
+// missing or mismatched. Returns what the dep ended up resolved to.
+std::optional<LockEntry> clone_single_dependency(const std::string &dep_name,
+                                                 const SyncOptions &options,
+                                                 const LockEntry *locked,
+                                                 JobLog &log) {
+    auto mode = options.fetch;
+    trace::Scope span("sync " + dep_name, "dependency");
+    // Everything it's about to delete and write is named after it
+    if (!valid_dep_name(dep_name)) {
+        log.error("[🚀] ❌ '{}' isn't a valid dependency name", dep_name);
+        return std::nullopt;
+    }
+    std::string dep_path = std::format("build/deps/{}", dep_name);
+    std::string include_path = std::format("build/includes/{}", dep_name);
+    bool repair = false; // What's on disk didn't match the lock
+
+    // The locked commit came back with other contents, so upstream was
+    // rewritten or tampered with. The dep fails and keeps its old pin until
+    // that's accepted with --update.
+    auto changed_upstream = [&](const LockEntry &entry) {
+        if (!locked || options.update || entry.content == locked->content)
+            return false;
+        log.error("[🚀] ❌ '{}' at {} doesn't have the contents recorded in {}",
+                  dep_name, locked->commit.substr(0, 12), LOCKFILE_PATH);
+        log.info("[🚀] 💡 If that's expected, run 'dreamcpp sync --update' "
+                 "to accept the new contents");
+        std::error_code ec;
+        std::filesystem::remove_all(dep_path, ec);
+        std::filesystem::remove_all(include_path, ec);
+        return true;
+    };
+
+    if (std::filesystem::exists(dep_path)) {
+        if (!locked && std::filesystem::exists(dep_path + "/.git")) {
+            // Synced before there was a lockfile, adopt what's on disk
+            log.info("[🚀] ⏭️  Skipping '{}' (already exists)", dep_name);
+            auto origin = process::run(
+                {"git", "-C", dep_path, "remote", "get-url", "origin"});
+            auto git = origin.exit_code == 0
+                           ? origin.output.substr(0, origin.output.find('\n'))
+                           : "";
+            return LockEntry{git, git_head_revision(dep_path),
+                             hash_dependency_tree(dep_name),
+                             std::filesystem::exists(include_path)};
+        }
+        if (locked && matches_lock(dep_name, *locked)) {
+            log.info("[🚀] ⏭️  Skipping '{}' (matches {})", dep_name,
+                     LOCKFILE_PATH);
+            return *locked;
+        }
+        // Without a lock entry there's nothing saying where a store copy
+        // came from, but fetching it again is cheap
+        if (locked) {
+            log.warn("[🚀] ⚠️ '{}' doesn't match {}, fetching it again",
+                     dep_name, LOCKFILE_PATH);
+            repair = true;
+        } else {
+            log.warn("[🚀] ⚠️ '{}' has no .git or {} entry to check it "
+                     "against, replacing it",
+                     dep_name, LOCKFILE_PATH);
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(dep_path, ec);
+        std::filesystem::remove_all(include_path, ec);
+    }
+
+    // A lock entry already says exactly what to fetch, no index needed
+    std::optional<DepIndex> repo_index;
+    if (locked) {
+        repo_index = DepIndex{};
+        repo_index->git = locked->git;
+        repo_index->header_only = locked->header_only;
+        if (locked->archive.empty()) {
+            repo_index->rev = locked->commit;
+        } else {
+            repo_index->archive = locked->archive;
+            repo_index->sha256 = locked->commit;
+            repo_index->strip = locked->strip;
+        }
+    } else {
+        repo_index = resolve_dependency_url(dep_name);
+    }
+    if (!repo_index.has_value()) {
+        log.warn("[🚀] ⚠️ Failed to resolve dependency: {}", dep_name);
+        return std::nullopt;
+    }
+
+    // Pinned releases don't need git at all, unless its history was asked for
+    bool use_archive = repo_index->archive.has_value() &&
+                       (mode == FetchMode::Shallow || repo_index->git.empty());
+    if (use_archive && !repo_index->sha256.has_value()) {
+        log.error("[🚀] ❌ '{}' has an archive but no sha256 to check it "
+                  "against",
+                  dep_name);
+        return std::nullopt;
+    }
+
+    // Blobless and full clones are wanted for their .git, which the store
+    // doesn't keep, so those still get a clone of their own
+    if (!use_archive && mode != FetchMode::Shallow) {
+        if (!fetch_dependency(dep_name, *repo_index, false, mode, dep_path, log))
+            return std::nullopt;
+        if (repo_index->header_only) {
+            try {
+                std::filesystem::create_directory(include_path);
+                std::filesystem::rename(
+                    std::format("build/deps/{}/include/{}", dep_name, dep_name),
+                    include_path);
+            } catch (const std::filesystem::filesystem_error &e) {
+                log.warn("[🚀] ⚠️ Couldn't move header-only include for "
+                         "'{}': {}",
+                         dep_name, e.what());
+            }
+        }
+        LockEntry entry{repo_index->git, git_head_revision(dep_path),
+                        hash_dependency_tree(dep_name), repo_index->header_only};
+        if (changed_upstream(entry))
+            return std::nullopt;
+        log.info("[🚀] ✅ Successfully cloned: {}", dep_name);
+        return entry;
+    }
+
+    // The same archive unpacked differently is a different tree
+    auto tree_key = [&](const std::string &commit) {
+        return use_archive ? std::format("{}-{}", commit, repo_index->strip)
+                           : commit;
+    };
+    std::optional<std::string> commit;
+    if (use_archive)
+        commit = repo_index->sha256;
+    else if (locked)
+        commit = locked->commit;
+    else
+        commit = remote_revision(*repo_index);
+
+    std::optional<store::Tree> tree;
+    if (commit.has_value())
+        tree = store::load(dep_name, tree_key(*commit));
+    // The mismatch may well have come from the store, relinking the same
+    // blobs would just record the damage as the dep's contents
+    if (tree.has_value() && repair &&
+        !store::verify(*tree, dep_name, tree_key(*commit))) {
+        log.warn("[🗃️] ⚠️ The store's copy of '{}' was modified, fetching it "
+                 "again",
+                 dep_name);
+        tree.reset();
+    }
+    bool fetched = !tree.has_value();
+    if (fetched) {
+        auto scratch = store::scratch_dir(dep_name);
+        auto checkout = scratch / "tree";
+        bool ok = fetch_dependency(dep_name, *repo_index, use_archive, mode,
+                                   checkout, log);
+        if (ok) {
+            commit = use_archive ? *repo_index->sha256
+                                 : git_head_revision(checkout);
+            if (auto error = store::ingest(checkout, dep_name,
+                                           tree_key(*commit), repair)) {
+                log.error("[🚀] ❌ Couldn't add '{}' to the store: {}",
+                          dep_name, *error);
+                ok = false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(scratch, ec);
+        if (!ok)
+            return std::nullopt;
+        tree = store::load(dep_name, tree_key(*commit));
+    }
+
+    if (auto error = tree.has_value()
+                         ? store::materialize(*tree, dep_name,
+                                              repo_index->header_only,
+                                              dep_path, include_path)
+                         : "the store lost it") {
+        log.error("[🚀] ❌ Couldn't materialize '{}': {}", dep_name, *error);
+        std::error_code ec;
+        std::filesystem::remove_all(dep_path, ec);
+        std::filesystem::remove_all(include_path, ec);
+        return std::nullopt;
+    }
+    std::ofstream(std::filesystem::path(dep_path) / REVISION_STAMP)
+        << *commit << "\n";
+
+    LockEntry entry{repo_index->git,
+                    *commit,
+                    store::content_hash(*tree, dep_name, repo_index->header_only),
+                    repo_index->header_only,
+                    use_archive ? *repo_index->archive : "",
+                    repo_index->strip};
+    if (changed_upstream(entry))
+        return std::nullopt;
+
+    if (!fetched)
+        log.info("[🚀] ✅ Successfully linked from the store: {}", dep_name);
+    else
+        log.info("[🚀] ✅ Successfully {}: {}",
+                 use_archive ? "downloaded" : "cloned", dep_name);
+    return entry;
+}
+
+// `dep_names` plus whatever their index entries say they need, and so on.
+// Locked deps keep what was pulled in for them without asking the index.
+std::vector<std::string>
+with_dependencies(const std::vector<std::string> &dep_names,
+                  const std::optional<Lockfile> &lock,
+                  std::map<std::string, std::string> &required_by) {
+    // Everything that isn't pinned yet gets resolved, so ask for it together
+    std::vector<std::string> unresolved;
+    for (const auto &name : dep_names) {
+        if ((!lock.has_value() || !lock->contains(name)) &&
+            !search_local_indexes(name).has_value())
+            unresolved.push_back(name);
+    }
+    prefetch_remote(unresolved);
+
+    std::vector<std::string> all = dep_names;
+    std::set<std::string> seen(all.begin(), all.end());
+    for (size_t i = 0; i < all.size(); ++i) {
+        std::vector<std::string> needs;
+        if (lock.has_value() && lock->contains(all[i])) {
+            for (const auto &[name, entry] : *lock) {
+                if (entry.required_by == all[i])
+                    needs.push_back(name);
+            }
+        } else if (auto index = resolve_dependency_url(all[i])) {
+            needs = index->dependencies;
+        }
+        for (const auto &need : needs) {
+            if (seen.insert(need).second) {
+                required_by[need] = all[i];
+                all.push_back(need);
+            }
+        }
+    }
+    return all;
+}
+
+// Deps the project doesn't list itself but sync pulled in for ones it does
+std::vector<std::string> required_deps() {
+    std::vector<std::string> names;
+    if (auto lock = load_lockfile()) {
+        for (const auto &[name, entry] : *lock) {
+            if (!entry.required_by.empty())
+                names.push_back(name);
+        }
+    }
+    return names;
+}
+
+// Makes build/deps (and build/includes) hold exactly `requested` and what
+// they need, as pinned by dreamcpp.lock where it has them
+bool sync_deps(const std::vector<std::string> &requested,
+               const SyncOptions &options) {
+    auto lock = load_lockfile();
+    std::map<std::string, std::string> required_by;
+    auto dep_names = with_dependencies(requested, lock, required_by);
+
+    // Fast path: the lockfile covers exactly these deps and everything on
+    // disk still matches it, so there's nothing to resolve or fetch
+    if (lock.has_value() && lock->size() == dep_names.size() &&
+        std::all_of(dep_names.begin(), dep_names.end(), [&](const auto &name) {
+            auto entry = lock->find(name);
+            return entry != lock->end() && matches_lock(name, entry->second);
+        })) {
+        spdlog::info("[🚀] ✅ All dependencies match {}", LOCKFILE_PATH);
+        return true;
+    }
+
+    // Create deps directory if it doesn't exist
+    std::filesystem::create_directories("build/deps");
+
+    // Create includes directory if it doesn't exist
+    std::filesystem::create_directories("build/includes");
+
+    // Clone in parallel; one failed dep shouldn't stop the others
+    std::vector<Job> jobs;
+    std::vector<std::optional<LockEntry>> resolved(dep_names.size());
+    for (size_t i = 0; i < dep_names.size(); ++i) {
+        const LockEntry *locked = nullptr;
+        if (lock.has_value()) {
+            if (auto entry = lock->find(dep_names[i]); entry != lock->end())
+                locked = &entry->second;
+        }
+        auto clone = [&, i, locked](JobLog &log) {
+            resolved[i] =
+                clone_single_dependency(dep_names[i], options, locked, log);
+            if (!resolved[i].has_value())
+                return false;
+            resolved[i]->required_by =
+                get_or_nullopt(required_by, dep_names[i]).value_or("");
+            return true;
+        };
+        jobs.push_back({dep_names[i], clone});
+    }
+    bool all_success = run_jobs(jobs, options.jobs, true);
+
+    // Deps that failed keep their old pin rather than silently losing it
+    Lockfile new_lock;
+    for (size_t i = 0; i < dep_names.size(); ++i) {
+        if (resolved[i].has_value()) {
+            new_lock[dep_names[i]] = *resolved[i];
+        } else if (lock.has_value() && lock->contains(dep_names[i])) {
+            new_lock[dep_names[i]] = lock->at(dep_names[i]);
+        }
+    }
+    save_lockfile(new_lock);
+
+    if (all_success) {
+        spdlog::info("[🚀] ✅ All dependencies synced successfully");
+    } else {
+        spdlog::warn("[🚀] ⚠️ Some dependencies failed to sync");
+    }
+
+    return all_success;
+}
+
+bool sync(const SyncOptions &options = {}) {
+    trace::Scope span("sync", "sync");
+    spdlog::info("[🚀] Syncing project dependencies...");
+
+    if (!validate_project_environment()) {
+        return false;
+    }
+
+    // Parse current config
+    auto app = parse_config_file(
+        "dreamcpp.toml", std::filesystem::current_path().filename().string());
+    if (!app.has_value()) {
+        return false;
+    }
+
+    if (app->deps.empty()) {
+        spdlog::info("[🚀] ✅ No dependencies to sync");
+        return true;
+    }
+
+    std::vector<std::string> dep_names;
+    for (const auto &dep : app->deps) {
+        if (dep.system) {
+            spdlog::info("[🚀] Skipping '{}', is a system library.", dep.name);
+        } else {
+            dep_names.push_back(dep.name);
+        }
+    }
+
+    return sync_deps(dep_names, options);
+}
+} // namespace dependency
+
+struct TranslationUnit {
+    std::string source;
+    std::string object;
+    std::string depfile;
+};
+
+namespace graph {
+const std::string GRAPH_FILE = "build.graph"; // Lives next to the objects
+const std::string GRAPH_HEADER = "dreamcpp-graph 1";
+
+struct Unit {
+    std::string command_hash;
+    std::vector<std::string> deps; // The source itself + every header it pulls in
+};
+
+struct BuildGraph {
+    std::string link_hash;
+    std::map<std::string, Unit> units; // Keyed by source path
+};
+
+std::string hash_command(const std::vector<std::string> &argv) {
+    uint64_t hash = FNV_OFFSET;
+    for (const auto &arg : argv) {
+        hash = fnv1a(arg, hash);
+        hash = fnv1a(std::string_view("\0", 1), hash); // Keep {"ab"} != {"a", "b"}
+    }
+    return std::format("{:016x}", hash);
+}
+
+// Missing or outdated graph files just mean "rebuild everything", never an error
+BuildGraph load(const std::string &fp) {
+    BuildGraph graph;
+    std::ifstream file(fp);
+    std::string line;
+    if (!file.is_open() || !std::getline(file, line) || line != GRAPH_HEADER) {
+        return graph;
+    }
+
+    Unit *current = nullptr;
+    while (std::getline(file, line)) {
+        auto space = line.find(' ');
+        if (space == std::string::npos)
+            continue;
+        auto kind = line.substr(0, space);
+        auto value = line.substr(space + 1);
+
+        if (kind == "link") {
+            graph.link_hash = value;
+        } else if (kind == "unit") {
+            current = &graph.units[value];
+        } else if (current && kind == "cmd") {
+            current->command_hash = value;
+        } else if (current && kind == "dep") {
+            current->deps.push_back(value);
+        }
+    }
+    return graph;
+}
+
+bool save(const BuildGraph &graph, const std::string &fp) {
+    // Write next to the real file and rename, so a crash can't leave half a graph
+    std::string tmp = fp + ".tmp";
+    {
+        std::ofstream file(tmp);
+        if (!file.is_open()) {
+            spdlog::warn("[⚒️] ⚠️ Couldn't write build graph '{}'.", fp);
+            return false;
+        }
+        file << GRAPH_HEADER << '\n';
+        if (!graph.link_hash.empty())
+            file << "link " << graph.link_hash << '\n';
+        for (const auto &[source, unit] : graph.units) {
+            file << "unit " << source << '\n';
+            file << "cmd " << unit.command_hash << '\n';
+            for (const auto &dep : unit.deps) {
+                file << "dep " << dep << '\n';
+            }
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, fp, ec);
+    return !ec;
+}
+
+// Parses a make-style depfile as written by -MMD ("obj.o: src.cpp a.hpp \")
+std::vector<std::string> parse_depfile(const std::string &fp) {
+    std::ifstream file(fp);
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+
+    std::vector<std::string> deps;
+    std::string current;
+    bool seen_target = false;
+    auto flush = [&]() {
+        if (seen_target && !current.empty())
+            deps.push_back(current);
+        current.clear();
+    };
+
+    for (size_t i = 0; i < content.size(); ++i) {
+        char c = content[i];
+        char next = i + 1 < content.size() ? content[i + 1] : '\0';
+
+        if (c == '\\' && (next == '\n' || next == '\r')) {
+            flush(); // Line continuation
+            ++i;
+        } else if (c == '\n' && seen_target) {
+            break; // gcc adds rules for modules after ours, they aren't files
+        } else if (c == '\\' && (next == ' ' || next == '#' || next == '\\')) {
+            current += next; // Escaped character inside a path
+            ++i;
+        } else if (c == '$' && next == '$') {
+            current += '$';
+            ++i;
+        } else if (!seen_target && c == ':' &&
+                   (next == '\0' || std::isspace((unsigned char)next))) {
+            current.clear(); // Everything before the colon is the object itself
+            seen_target = true;
+        } else if (std::isspace((unsigned char)c)) {
+            flush();
+        } else {
+            current += c;
+        }
+    }
+    flush();
+    return deps;
+}
+
+// Headers are shared between most units, so only stat each of them once
+struct MtimeCache {
+    std::unordered_map<std::string,
+                       std::optional<std::filesystem::file_time_type>>
+        times;
+
+    std::optional<std::filesystem::file_time_type>
+    get(const std::string &fp) {
+        if (auto it = times.find(fp); it != times.end())
+            return it->second;
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(fp, ec);
+        std::optional<std::filesystem::file_time_type> result;
+        if (!ec)
+            result = time;
+        times.emplace(fp, result);
+        return result;
+    }
+};
+
+bool is_stale(const TranslationUnit &tu, const Unit *unit,
+              const std::string &command_hash, MtimeCache &mtimes) {
+    if (!unit || unit->command_hash != command_hash || unit->deps.empty())
+        return true;
+
+    std::error_code ec;
+    auto object_time = std::filesystem::last_write_time(tu.object, ec);
+    if (ec)
+        return true;
+
+    for (const auto &dep : unit->deps) {
+        auto dep_time = mtimes.get(dep);
+        if (!dep_time.has_value() || *dep_time > object_time)
+            return true;
+    }
+    return false;
+}
+
+bool needs_link(const std::string &output,
+                const std::vector<std::string> &objects) {
+    std::error_code ec;
+    auto output_time = std::filesystem::last_write_time(output, ec);
+    if (ec)
+        return true;
+    for (const auto &object : objects) {
+        auto object_time = std::filesystem::last_write_time(object, ec);
+        if (ec || object_time > output_time)
+            return true;
+    }
+    return false;
+}
+} // namespace graph
+
+namespace cache {
+struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+std::filesystem::path object_dir() { return dreamcpp_home() / "cache" / "obj"; }
+
+std::filesystem::path stats_path() {
+    return dreamcpp_home() / "cache" / "stats.toml";
+}
+
+Stats load_stats() {
+    Stats stats;
+    try {
+        auto tbl = toml::parse_file(stats_path().string());
+        stats.hits = tbl["hits"].value_or<int64_t>(0);
+        stats.misses = tbl["misses"].value_or<int64_t>(0);
+    } catch (const std::exception &) {
+        // No stats yet
+    }
+    return stats;
+}
+
+void record_stats(const Stats &delta) {
+    if (delta.hits == 0 && delta.misses == 0)
+        return;
+    std::error_code ec;
+    std::filesystem::create_directories(stats_path().parent_path(), ec);
+    // Workspace members build at once, so updates take turns. The lock is a
+    // file of its own since the stats file gets replaced, never rewritten.
+    auto lock_path = stats_path();
+    lock_path += ".lock";
+    int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd >= 0)
+        flock(lock_fd, LOCK_EX);
+    auto stats = load_stats();
+    stats.hits += delta.hits;
+    stats.misses += delta.misses;
+
+    toml::table tbl;
+    tbl.insert("hits", (int64_t)stats.hits);
+    tbl.insert("misses", (int64_t)stats.misses);
+    auto tmp = stats_path();
+    tmp += std::format(".tmp-{}", getpid());
+    {
+        std::ofstream file(tmp);
+        file << tbl;
+        file.close();
+        if (file.good())
+            std::filesystem::rename(tmp, stats_path(), ec);
+    }
+    std::filesystem::remove(tmp, ec);
+    if (lock_fd >= 0)
+        close(lock_fd);
+}
+
+// `--version` output, so upgrading the compiler invalidates everything
+std::string compiler_identity(const std::string &compiler) {
+    // Several build steps ask, and `watch` builds over and over
+    static std::mutex mutex;
+    static std::map<std::string, std::string> known;
+    std::lock_guard lock(mutex);
+    if (auto it = known.find(compiler); it != known.end())
+        return it->second;
+    auto out = process::run({compiler, "--version"});
+    return known[compiler] = out.exit_code == 0 ? out.output : compiler;
+}
+
+// Everything except the preprocessed source that can change the object
+std::string key_prefix(const AppConfig &config, const std::string &identity,
+                       const std::vector<std::string> &compile_flags,
+                       const std::vector<std::string> &link_flags) {
+    std::string prefix = "dreamcpp-obj 1\n" + identity + "\n" +
+                         config.preferred_compiler + "\n" + config.standard +
+                         "\n";
+    for (const auto &flag : compile_flags) {
+        prefix += flag + "\n";
+    }
+    for (const auto &flag : link_flags) {
+        prefix += flag + "\n";
+    }
+    return prefix;
+}
+
+std::filesystem::path entry_path(const std::string &key) {
+    return object_dir() / key.substr(0, 2) / (key + ".o");
+}
+
+// Copies (never links: the compiler rewrites objects in place) a cached
+// object to `dest`, bumping its mtime so trim() sees it as recently used
+bool restore(const std::string &key, const std::string &dest) {
+    auto entry = entry_path(key);
+    std::error_code ec;
+    std::filesystem::copy_file(
+        entry, dest, std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec)
+        return false;
+    std::filesystem::last_write_time(
+        entry, std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void store(const std::string &key, const std::string &object) {
+    auto entry = entry_path(key);
+    std::error_code ec;
+    std::filesystem::create_directories(entry.parent_path(), ec);
+
+    // Other builds may be storing the same key right now, so copy to a
+    // private name first and rename into place
+    auto tmp = entry;
+    tmp += std::format(".tmp{}-{:x}", getpid(),
+                       std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    std::filesystem::copy_file(
+        object, tmp, std::filesystem::copy_options::overwrite_existing, ec);
+    if (!ec)
+        std::filesystem::rename(tmp, entry, ec);
+    if (ec)
+        std::filesystem::remove(tmp, ec);
+}
+
+struct Entry {
+    std::filesystem::path path;
+    uintmax_t size;
+    std::filesystem::file_time_type used;
+};
+
+std::vector<Entry> list_entries() {
+    std::vector<Entry> entries;
+    std::error_code ec;
+    if (!std::filesystem::exists(object_dir(), ec))
+        return entries;
+    for (const auto &file :
+         std::filesystem::recursive_directory_iterator(object_dir(), ec)) {
+        // .dwo files were cached next to their objects once, trim those too
+        auto extension = file.path().extension();
+        if (file.is_regular_file(ec) &&
+            (extension == ".o" || extension == ".dwo")) {
+            entries.push_back({file.path(), file.file_size(ec),
+                               file.last_write_time(ec)});
+        }
+    }
+    return entries;
+}
+
+std::string format_size(uintmax_t bytes) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double size = (double)bytes;
+    int unit = 0;
+    while (size >= 1024 && unit < 4) {
+        size /= 1024;
+        ++unit;
+    }
+    return std::format("{:.1f} {}", size, units[unit]);
+}
+
+// "500M", "2G", "1024" (bytes)...
+std::optional<uintmax_t> parse_size(const std::string &text) {
+    try {
+        size_t end = 0;
+        double value = std::stod(text, &end);
+        std::string suffix = text.substr(end);
+        uintmax_t scale = 1;
+        if (suffix == "K" || suffix == "KiB")
+            scale = 1ull << 10;
+        else if (suffix == "M" || suffix == "MiB")
+            scale = 1ull << 20;
+        else if (suffix == "G" || suffix == "GiB")
+            scale = 1ull << 30;
+        else if (!suffix.empty() && suffix != "B")
+            return std::nullopt;
+        if (value < 0)
+            return std::nullopt;
+        return (uintmax_t)(value * scale);
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
+
+void print_stats() {
+    auto stats = load_stats();
+    auto entries = list_entries();
+    uintmax_t total = 0;
+    for (const auto &entry : entries) {
+        total += entry.size;
+    }
+    uint64_t lookups = stats.hits + stats.misses;
+
+    spdlog::info("[🗃️] Cache: {}", object_dir().string());
+    spdlog::info("[🗃️] Objects: {} ({})", entries.size(), format_size(total));
+    spdlog::info("[🗃️] Hits: {}, misses: {} ({:.1f}% hit rate)", stats.hits,
+                 stats.misses,
+                 lookups ? 100.0 * stats.hits / lookups : 0.0);
+}
+
+// Evicts least recently used objects until the cache fits in `max_bytes`
+void trim(uintmax_t max_bytes) {
+    auto entries = list_entries();
+    std::sort(entries.begin(), entries.end(),
+              [](const auto &a, const auto &b) { return a.used < b.used; });
+
+    uintmax_t total = 0;
+    for (const auto &entry : entries) {
+        total += entry.size;
+    }
+
+    size_t evicted = 0;
+    uintmax_t freed = 0;
+    for (const auto &entry : entries) {
+        if (total <= max_bytes)
+            break;
+        std::error_code ec;
+        if (std::filesystem::remove(entry.path, ec)) {
+            total -= entry.size;
+            freed += entry.size;
+            ++evicted;
+        }
+    }
+    spdlog::info("[🗃️] ✅ Evicted {} objects ({}), cache is now {}", evicted,
+                 format_size(freed), format_size(total));
+}
+
+void clear() {
+    std::error_code ec;
+    std::filesystem::remove_all(object_dir(), ec);
+    std::filesystem::remove_all(dreamcpp_home() / "cache" / "lib", ec);
+    std::filesystem::remove(stats_path(), ec);
+    spdlog::info("[🗃️] ✅ Cleared the compile cache");
+}
+} // namespace cache
+
+namespace profile {
+const std::set<std::string> OPT_LEVELS = {"0", "1", "2", "3", "s", "z", "g", "fast"};
+const std::set<std::string> LTO_MODES = {"off", "thin", "full"};
+const std::set<std::string> LINKERS = {"auto", "default", "mold",
+                                       "lld",  "gold",    "bfd"};
+
+std::optional<Profile> builtin(const std::string &name) {
+    if (name == "debug")
+        return Profile{};
+    if (name == "release") {
+        return Profile{"release", "3", false, "off", "build/release",
+                       {"-DNDEBUG"}, {}, ""};
+    }
+    if (name == "release-lto") {
+        return Profile{"release-lto", "3", false, "thin", "build/release-lto",
+                       {"-DNDEBUG"}, {}, ""};
+    }
+    return std::nullopt;
+}
+
+std::optional<Profile> resolve(const AppConfig &config, const std::string &name,
+                               int depth = 0) {
+    if (depth > 16) {
+        spdlog::error("[⚒️] ❌ Profile '{}' inherits from itself", name);
+        return std::nullopt;
+    }
+    auto found = config.profiles.find(name);
+    auto base = builtin(name);
+    if (found == config.profiles.end() && !base.has_value()) {
+        spdlog::error("[⚒️] ❌ No profile named '{}' (built in: debug, "
+                      "release, release-lto)",
+                      name);
+        return std::nullopt;
+    }
+
+    // Built-ins still go through the checks below for the top-level linker
+    static const ProfileConfig no_overrides;
+    const auto &overrides =
+        found == config.profiles.end() ? no_overrides : found->second;
+    if (overrides.inherits.has_value() || !base.has_value()) {
+        base = resolve(config, overrides.inherits.value_or("debug"), depth + 1);
+        if (!base.has_value())
+            return std::nullopt;
+        // Sharing an object dir with the parent would rebuild both every time
+        base->output_dir = std::format("build/{}", name);
+    }
+    Profile profile = *base;
+    profile.name = name;
+    profile.opt_level = overrides.opt_level.value_or(profile.opt_level);
+    profile.debug_info = overrides.debug_info.value_or(profile.debug_info);
+    profile.lto = overrides.lto.value_or(profile.lto);
+    profile.output_dir = overrides.output_dir.value_or(profile.output_dir);
+    profile.flags = overrides.flags.value_or(profile.flags);
+    profile.link_flags = overrides.link_flags.value_or(profile.link_flags);
+    profile.pgo_train = overrides.pgo_train.value_or(profile.pgo_train);
+    if (overrides.unity.has_value()) {
+        if (*overrides.unity < 0) {
+            spdlog::error("[⚒️] ❌ Profile '{}': unity can't be negative",
+                          name);
+            return std::nullopt;
+        }
+        profile.unity = static_cast<unsigned>(*overrides.unity);
+    }
+    profile.linker = overrides.linker.value_or(profile.linker);
+    profile.split_debug = overrides.split_debug.value_or(profile.split_debug);
+
+    if (!OPT_LEVELS.contains(profile.opt_level)) {
+        spdlog::error("[⚒️] ❌ Profile '{}': unknown opt level '{}'", name,
+                      profile.opt_level);
+        return std::nullopt;
+    }
+    if (profile.linker.empty())
+        profile.linker = config.linker.value_or("auto");
+    if (!LINKERS.contains(profile.linker)) {
+        spdlog::error("[⚒️] ❌ Profile '{}': linker must be auto, default, "
+                      "mold, lld, gold or bfd, not '{}'",
+                      name, profile.linker);
+        return std::nullopt;
+    }
+    if (!LTO_MODES.contains(profile.lto)) {
+        spdlog::error("[⚒️] ❌ Profile '{}': lto must be off, thin or full, "
+                      "not '{}'",
+                      name, profile.lto);
+        return std::nullopt;
+    }
+    return profile;
+}
+
+bool is_clang(const std::string &compiler) {
+    return cache::compiler_identity(compiler).find("clang") !=
+           std::string::npos;
+}
+
+// Goes on both the compile and link lines, LTO happens at link time
+std::vector<std::string> lto_flags(const Profile &profile, bool clang) {
+    if (profile.lto == "off")
+        return {};
+    if (clang)
+        return {profile.lto == "thin" ? "-flto=thin" : "-flto"};
+    if (profile.lto == "thin")
+        spdlog::debug("[⚒️] gcc has no ThinLTO, using parallel full LTO");
+    return {"-flto=auto"};
+}
+} // namespace profile
+
+namespace linker {
+// Fastest first
+const std::vector<std::string> PREFERRED = {"mold", "lld", "gold", "bfd"};
+
+bool in_path(const std::string &program) {
+    const char *path = std::getenv("PATH");
+    if (path == nullptr)
+        return false;
+    std::stringstream dirs(path);
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+        if (dir.empty())
+            dir = ".";
+        if (access((std::filesystem::path(dir) / program).c_str(), X_OK) == 0)
+            return true;
+    }
+    return false;
+}
+
+// What -fuse-ld=<name> would look for
+bool available(const std::string &name) {
+    if (name == "mold" && in_path("mold"))
+        return true;
+    return in_path("ld." + name);
+}
+
+// The -fuse-ld= value for this profile, "" for the compiler's default, or
+// nullopt if the profile asked for one that isn't installed
+std::optional<std::string> choose(const Profile &profile,
+                                  const std::string &compiler) {
+    if (profile.linker == "default")
+        return "";
+    if (profile.linker != "auto") {
+        if (!available(profile.linker)) {
+            spdlog::error("[⚒️] ❌ Profile '{}' wants the {} linker, but it "
+                          "isn't installed",
+                          profile.name, profile.linker);
+            return std::nullopt;
+        }
+        return profile.linker;
+    }
+
+    // LTO needs a linker that can load the compiler's plugin
+    bool lto = profile.lto != "off";
+    bool clang = lto && profile::is_clang(compiler);
+    for (const auto &name : PREFERRED) {
+        if (lto && !clang && name == "lld")
+            continue;
+        if (lto && clang && (name == "gold" || name == "bfd"))
+            continue;
+        if (available(name)) {
+            spdlog::debug("[⚒️] Using the {} linker", name);
+            return name;
+        }
+    }
+    return "";
+}
+} // namespace linker
+
+// Blanks out comments and string literals (keeping newlines) so the scanners
+// only ever see code
+std::string strip_comments(const std::string &src) {
+    std::string out = src;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out.compare(i, 2, "//") == 0) {
+            for (; i < out.size() && out[i] != '\n'; ++i)
+                out[i] = ' ';
+        } else if (out.compare(i, 2, "/*") == 0) {
+            auto end = out.find("*/", i + 2);
+            end = end == std::string::npos ? out.size() : end + 2;
+            for (; i < end; ++i) {
+                if (out[i] != '\n')
+                    out[i] = ' ';
+            }
+            --i;
+        } else if (out[i] == '"' && (i == 0 || out[i - 1] != '\'')) {
+            for (++i; i < out.size() && out[i] != '"' && out[i] != '\n'; ++i) {
+                if (out[i] == '\\' && i + 1 < out.size())
+                    out[i++] = ' ';
+                out[i] = ' ';
+            }
+        }
+    }
+    return out;
+}
+
+namespace pch {
+// Every <header> or "header" included under src/, leaving out commented ones
+// and any behind #if: those may not even exist on this machine, and one
+// missing header fails the whole PCH. Include guards don't count as an #if.
+std::set<std::string> scan_includes() {
+    std::set<std::string> includes;
+    for (const auto &entry : std::filesystem::directory_iterator("src")) {
+        if (!entry.is_regular_file())
+            continue;
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+        // Same lines, but strings are blanked too, so names come from `lines`
+        std::istringstream code_lines(strip_comments(content));
+        std::istringstream lines(content);
+        std::string code, line;
+        std::vector<bool> conditions; // Open #ifs, false for the guard
+        std::string guard;            // Name the first #ifndef tests
+        bool first = true;
+        while (std::getline(code_lines, code) && std::getline(lines, line)) {
+            auto start = code.find_first_not_of(" \t");
+            if (start == std::string::npos || code[start] != '#')
+                continue;
+            std::istringstream words(code.substr(start + 1));
+            std::string directive, name;
+            words >> directive >> name;
+            directive = directive.substr(0, directive.find_first_of("<\""));
+
+            bool was_first = std::exchange(first, false);
+            if (!guard.empty()) {
+                // #ifndef X right away followed by #define X
+                if (directive != "define" || name != guard)
+                    conditions.front() = true;
+                guard.clear();
+            }
+            if (directive == "if" || directive == "ifdef" ||
+                directive == "ifndef") {
+                bool maybe_guard = was_first && directive == "ifndef";
+                conditions.push_back(!maybe_guard);
+                if (maybe_guard)
+                    guard = name;
+            } else if (directive == "endif" && !conditions.empty()) {
+                conditions.pop_back();
+            } else if (directive == "include" &&
+                       std::find(conditions.begin(), conditions.end(), true) ==
+                           conditions.end()) {
+                auto open = line.find_first_of("<\"", line.find("include"));
+                if (open == std::string::npos)
+                    continue;
+                auto close = line.find_first_of(">\"", open + 1);
+                if (close != std::string::npos)
+                    includes.insert(line.substr(open + 1, close - open - 1));
+            }
+        }
+    }
+    return includes;
+}
+
+// Builds (or reuses) a precompiled header covering every header the project
+// includes from its header-only deps. Returns the header to force-include.
+std::optional<std::string>
+prepare(const AppConfig &config, const std::vector<std::string> &compile_flags,
+        const std::filesystem::path &pch_root) {
+    // sync() moves header-only deps into build/includes/<name>
+    std::map<std::string, std::string> revisions;
+    for (const auto &dep : config.deps) {
+        if (!dep.system && std::filesystem::is_directory(
+                               std::format("build/includes/{}", dep.name))) {
+            revisions[dep.name] = git_head_revision(
+                std::format("build/deps/{}", dep.name));
+        }
+    }
+    if (revisions.empty())
+        return std::nullopt;
+
+    std::vector<std::string> headers;
+    for (const auto &include : scan_includes()) {
+        auto root = include.substr(0, include.find('/'));
+        if (revisions.contains(root) &&
+            std::filesystem::exists("build/includes/" + include)) {
+            headers.push_back(include);
+        }
+    }
+    if (headers.empty())
+        return std::nullopt;
+
+    // The key ends up in the -include path, so every compile command (and
+    // with it the build graph and compile cache) changes along with the PCH.
+    // A .gch from another compiler version just gets rejected (or worse)
+    uint64_t hash = fnv1a(config.preferred_compiler);
+    hash = fnv1a(cache::compiler_identity(config.preferred_compiler), hash);
+    for (const auto &flag : compile_flags) {
+        hash = fnv1a(flag + "\n", hash);
+    }
+    for (const auto &header : headers) {
+        hash = fnv1a(header + "\n", hash);
+    }
+    for (const auto &[name, revision] : revisions) {
+        hash = fnv1a(name + "@" + revision + "\n", hash);
+    }
+    auto dir = pch_root / std::format("{:016x}", hash);
+    auto header_path = (dir / "dreamcpp_pch.hpp").generic_string();
+
+    // gcc picks up header.gch next to the header, clang header.pch
+    if (std::filesystem::exists(header_path + ".gch") ||
+        std::filesystem::exists(header_path + ".pch")) {
+        return header_path;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(pch_root, ec); // Outdated PCHs are huge
+    std::filesystem::create_directories(dir);
+    {
+        std::ofstream file(header_path);
+        file << "// Generated by dreamcpp from the project's header-only "
+                "dependencies\n";
+        for (const auto &header : headers) {
+            file << "#include <" << header << ">\n";
+        }
+    }
+
+    bool is_clang = profile::is_clang(config.preferred_compiler);
+    std::vector<std::string> pch_cmd = {config.preferred_compiler};
+    pch_cmd.insert(pch_cmd.end(), compile_flags.begin(), compile_flags.end());
+    pch_cmd.insert(pch_cmd.end(),
+                   {"-x", "c++-header", header_path, "-o",
+                    header_path + (is_clang ? ".pch" : ".gch")});
+
+    trace::Scope span("precompile headers", "pch");
+    spdlog::info("[⚒️] Precompiling headers from {}",
+                 join(revisions | std::views::keys, " ").substr(1));
+    auto out = process::run(pch_cmd);
+    if (out.exit_code != 0) {
+        spdlog::warn("[⚒️] ⚠️ Couldn't precompile headers, building without "
+                     "them: {}",
+                     out.output);
+        std::filesystem::remove_all(dir, ec);
+        return std::nullopt;
+    }
+    return header_path;
+}
+} // namespace pch
+
+namespace modules {
+// Module interface units, besides the usual .cpp
+const std::set<std::string> INTERFACE_EXTENSIONS = {".cppm", ".ixx"};
+const std::set<std::string> STD_MODULES = {"std", "std.compat"};
+
+struct Info {
+    std::string provides;             // "m" or "m:part", empty for plain TUs
+    bool interface = false;           // `export module ...`
+    std::vector<std::string> imports; // Partitions come back as "m:part"
+    std::vector<std::string> header_units; // import <vector>; (unsupported)
+
+    bool uses_modules() const { return !provides.empty() || !imports.empty(); }
+};
+
+// Finds module declarations and imports. They have to start a line, which
+// is how everyone writes them; imports behind #if aren't understood.
+Info scan(const std::string &fp) {
+    std::ifstream file(fp, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+    Info info;
+    // Most sources never mention either word, skip the real scan for them
+    if (content.find("module") == std::string::npos &&
+        content.find("import") == std::string::npos)
+        return info;
+
+    // `import :part;` names a partition of whatever module this unit is in
+    auto qualify = [&](std::string name) {
+        if (name.starts_with(':'))
+            name = info.provides.substr(0, info.provides.find(':')) + name;
+        return name;
+    };
+
+    std::istringstream lines(strip_comments(content));
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+            continue;
+        std::string_view rest(line);
+        rest.remove_prefix(begin);
+
+        bool exported = false;
+        if (rest.starts_with("export") && rest.size() > 6 &&
+            std::isspace((unsigned char)rest[6])) {
+            exported = true;
+            rest.remove_prefix(rest.find_first_not_of(" \t", 6));
+        }
+
+        bool is_module = rest.starts_with("module");
+        bool is_import = rest.starts_with("import");
+        if (!is_module && !is_import)
+            continue;
+        rest.remove_prefix(6);
+        // Just the start of an identifier like module_id
+        if (!rest.empty() &&
+            (std::isalnum((unsigned char)rest[0]) || rest[0] == '_'))
+            continue;
+
+        // Then a module name, partition or header and the ';' (or
+        // attributes) ending it. Anything else, like `module = 3;` or
+        // `import(x)`, is code using the word as a plain name.
+        auto start = rest.find_first_not_of(" \t\r");
+        rest.remove_prefix(std::min(start, rest.size()));
+        bool header = is_import && !rest.empty() &&
+                      (rest[0] == '<' || rest[0] == '"');
+        if (!rest.empty() && !header && rest[0] != ';' && rest[0] != ':' &&
+            !std::isalpha((unsigned char)rest[0]) && rest[0] != '_')
+            continue;
+        std::string name;
+        bool terminated = false;
+        for (char c : rest) {
+            if (c == ';' || c == '[') {
+                terminated = true;
+                break;
+            }
+            if (std::isspace((unsigned char)c))
+                continue;
+            if (!header && !std::isalnum((unsigned char)c) && c != '_' &&
+                c != '.' && c != ':')
+                break;
+            name += c;
+        }
+        if (!terminated)
+            continue;
+
+        if (is_module) {
+            // `module;` opens the global module fragment, `module :private;`
+            // closes the interface, neither names anything
+            if (name.empty() || name.starts_with(':'))
+                continue;
+            // An implementation unit implicitly imports its interface
+            if (!exported && name.find(':') == std::string::npos) {
+                info.imports.push_back(name);
+                continue;
+            }
+            info.provides = name;
+            info.interface = exported;
+        } else if (name.starts_with('<') || name.starts_with('"')) {
+            info.header_units.push_back(name);
+        } else if (!name.empty()) {
+            info.imports.push_back(qualify(name));
+        }
+    }
+    return info;
+}
+
+// What the BMI for `name` is called in a prebuilt module directory
+std::string bmi_name(const std::string &name, bool clang) {
+    auto file = name;
+    std::replace(file.begin(), file.end(), ':', '-');
+    return file + (clang ? ".pcm" : ".gcm");
+}
+
+// Pulls "key": "value" (or the strings of "key": [...]) out of a bit of JSON
+std::vector<std::string> json_strings(std::string_view json,
+                                      const std::string &key) {
+    std::vector<std::string> values;
+    auto at = json.find("\"" + key + "\"");
+    if (at == std::string_view::npos)
+        return values;
+    at = json.find(':', at);
+    if (at == std::string_view::npos)
+        return values;
+    auto start = json.find_first_not_of(" \t\r\n", at + 1);
+    if (start == std::string_view::npos)
+        return values;
+    auto end = json[start] == '[' ? json.find(']', start) : start + 1;
+    if (json[start] != '[') {
+        // A single string, find its closing quote
+        end = json.find('"', start + 1);
+        if (json[start] != '"' || end == std::string_view::npos)
+            return values;
+        values.emplace_back(json.substr(start + 1, end - start - 1));
+        return values;
+    }
+    for (auto open = json.find('"', start); open < end;
+         open = json.find('"', open + 1)) {
+        auto close = json.find('"', open + 1);
+        if (close == std::string_view::npos || close > end)
+            break;
+        values.emplace_back(json.substr(open + 1, close - open - 1));
+        open = close;
+    }
+    return values;
+}
+
+struct StdModules {
+    std::filesystem::path dir;                 // Holds the BMIs and objects
+    std::map<std::string, std::string> bmis;   // Module name -> BMI path
+    std::vector<std::string> objects;          // Have to be linked in
+};
+
+// `import std;` compiles the standard library's own module sources, found
+// through the manifest it ships (libc++ 17+, libstdc++ 15+). The BMIs only
+// depend on the toolchain and flags, so they're built once into
+// ~/.dreamcpp/cache/bmi and shared by every project.
+std::optional<StdModules> prepare_std(const std::string &compiler, bool clang,
+                                      const std::vector<std::string> &flags,
+                                      std::set<std::string> needed) {
+    std::string manifest_name =
+        clang ? "libc++.modules.json" : "libstdc++.modules.json";
+    std::vector<std::string> locate = {compiler};
+    locate.insert(locate.end(), flags.begin(), flags.end());
+    locate.push_back("-print-file-name=" + manifest_name);
+    auto located = process::run(locate);
+    auto manifest_path = located.output.substr(
+        0, located.output.find_last_not_of(" \r\n") + 1);
+    if (located.exit_code != 0 || !std::filesystem::exists(manifest_path) ||
+        manifest_path == manifest_name) {
+        spdlog::error("[⚒️] ❌ `import std;` needs a standard library that "
+                      "ships its module sources (libc++ 17+ with "
+                      "-stdlib=libc++, or libstdc++ 15+), and {} didn't "
+                      "find {}",
+                      compiler, manifest_name);
+        return std::nullopt;
+    }
+    std::ifstream file(manifest_path);
+    std::string manifest((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+    auto manifest_dir = std::filesystem::path(manifest_path).parent_path();
+
+    // std.compat is built on top of std
+    if (needed.contains("std.compat"))
+        needed.insert("std");
+
+    uint64_t hash = fnv1a(cache::compiler_identity(compiler));
+    for (const auto &flag : flags) {
+        hash = fnv1a(flag + "\n", hash);
+    }
+    StdModules result;
+    result.dir = dreamcpp_home() / "cache" / "bmi" / std::format("{:016x}", hash);
+    std::filesystem::create_directories(result.dir);
+
+    std::string mapper = std::format("$root {}\n", result.dir.string());
+    for (const auto &name : STD_MODULES) {
+        result.bmis[name] = (result.dir / bmi_name(name, clang)).string();
+        mapper += std::format("{} {}\n", name, bmi_name(name, clang));
+    }
+    auto mapper_path = (result.dir / "std.map").string();
+    write_if_changed(mapper_path, mapper);
+
+    // Manifest order already has std before std.compat
+    for (size_t at = manifest.find("\"logical-name\""); at != std::string::npos;
+         at = manifest.find("\"logical-name\"", at + 1)) {
+        auto object_start = manifest.rfind('{', at);
+        auto object_end = manifest.find("\"logical-name\"", at + 1);
+        std::string_view entry(manifest);
+        entry = entry.substr(object_start, object_end == std::string::npos
+                                               ? std::string::npos
+                                               : object_end - object_start);
+        auto name = json_strings(entry, "logical-name");
+        auto source = json_strings(entry, "source-path");
+        if (name.empty() || source.empty() || !needed.contains(name[0]))
+            continue;
+
+        auto object = (result.dir / (name[0] + ".o")).string();
+        result.objects.push_back(object);
+        auto stamp = result.dir / (name[0] + ".done");
+        if (std::filesystem::exists(stamp))
+            continue;
+
+        std::vector<std::string> cmd = {compiler};
+        cmd.insert(cmd.end(), flags.begin(), flags.end());
+        for (const auto &include :
+             json_strings(entry, "system-include-directories")) {
+            cmd.push_back("-isystem" + (manifest_dir / include).string());
+        }
+        if (clang) {
+            cmd.insert(cmd.end(),
+                       {"-Wno-reserved-module-identifier",
+                        "-fprebuilt-module-path=" + result.dir.string(), "-x",
+                        "c++-module", "-fmodule-output=" + result.bmis[name[0]]});
+        } else {
+            cmd.insert(cmd.end(), {"-fmodules-ts",
+                                   "-fmodule-mapper=" + mapper_path, "-x",
+                                   "c++"});
+        }
+        cmd.insert(cmd.end(), {"-c", (manifest_dir / source[0]).string(), "-o",
+                               object});
+
+        trace::Scope span("compile module " + name[0], "modules");
+        spdlog::info("[⚒️] Compiling the '{}' module (once per toolchain)",
+                     name[0]);
+        auto out = process::run(cmd);
+        if (out.exit_code != 0) {
+            spdlog::error("[⚒️] ❌ Failed to compile the '{}' module: {}",
+                          name[0], out.output);
+            return std::nullopt;
+        }
+        std::ofstream(stamp) << "ok\n";
+    }
+    return result;
+}
+} // namespace modules
+
+const std::string MAIN_SOURCE = "src/main.cpp";
+
+std::vector<TranslationUnit>
+collect_translation_units(const std::filesystem::path &obj_dir,
+                          const std::filesystem::path &source_dir = "src") {
+    std::vector<TranslationUnit> units;
+    for (const auto &entry : std::filesystem::directory_iterator(source_dir)) {
+        auto extension = entry.path().extension().string();
+        if (!entry.is_regular_file() ||
+            (extension != ".cpp" &&
+             !modules::INTERFACE_EXTENSIONS.contains(extension)))
+            continue;
+        auto stem =
+            (obj_dir / entry.path().filename()).generic_string();
+        units.push_back({entry.path().generic_string(), stem + ".o",
+                         stem + ".d"});
+    }
+    // directory_iterator order isn't stable, but the link line has to be
+    std::sort(units.begin(), units.end(),
+              [](const auto &a, const auto &b) { return a.source < b.source; });
+    return units;
+}
+
+namespace unity {
+const std::string ISOLATED_FILE = "unity.isolated"; // Lives next to the objects
+
+// Sources that broke a batch once and get compiled on their own since
+std::set<std::string> load_isolated(const std::filesystem::path &obj_dir) {
+    std::set<std::string> isolated;
+    std::ifstream file(obj_dir / ISOLATED_FILE);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty())
+            isolated.insert(line);
+    }
+    return isolated;
+}
+
+void save_isolated(const std::filesystem::path &obj_dir,
+                   const std::set<std::string> &isolated) {
+    std::ofstream file(obj_dir / ISOLATED_FILE);
+    for (const auto &source : isolated) {
+        file << source << '\n';
+    }
+}
+
+// Relative includes, so the preprocessed output (and with it the compile
+// cache key) doesn't depend on where the project is checked out
+std::string batch_source(const std::vector<TranslationUnit> &members,
+                         const std::filesystem::path &dir) {
+    std::string out = std::format(
+        "// Generated by dreamcpp: unity batch of {} sources\n", members.size());
+    for (const auto &member : members) {
+        out += std::format(
+            "#include \"{}\"\n",
+            std::filesystem::relative(member.source, dir).generic_string());
+    }
+    return out;
+}
+
+struct Batch {
+    TranslationUnit unit;
+    std::vector<TranslationUnit> members; // Just `unit` for a lone source
+};
+
+// Chunks the (sorted) units into batches of `size`, writing one unity source
+// per batch into <output_dir>/unity. Isolated sources stay standalone.
+std::vector<Batch> plan(const std::vector<TranslationUnit> &units,
+                        unsigned size, const std::set<std::string> &isolated,
+                        const std::filesystem::path &output_dir,
+                        const std::filesystem::path &obj_dir) {
+    std::vector<Batch> batches;
+    std::vector<TranslationUnit> pending;
+    for (const auto &tu : units) {
+        if (isolated.contains(tu.source)) {
+            batches.push_back({tu, {tu}});
+        } else {
+            pending.push_back(tu);
+        }
+    }
+
+    auto dir = output_dir / "unity";
+    std::filesystem::create_directories(dir);
+    std::set<std::string> written;
+    for (size_t start = 0; start < pending.size(); start += size) {
+        std::vector<TranslationUnit> members(
+            pending.begin() + start,
+            pending.begin() + std::min(pending.size(), start + size));
+        if (members.size() == 1) {
+            batches.push_back({members[0], members});
+            continue;
+        }
+        auto name = std::format("unity_{}.cpp", start / size);
+        auto source = (dir / name).generic_string();
+        write_if_changed(source, batch_source(members, dir));
+        written.insert(name);
+        auto stem = (obj_dir / name).generic_string();
+        batches.push_back({{source, stem + ".o", stem + ".d"}, members});
+    }
+
+    // Batches from a bigger project or batch size would just sit there
+    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+        if (!written.contains(entry.path().filename().string()))
+            std::filesystem::remove(entry.path());
+    }
+    return batches;
+}
+} // namespace unity
+
+namespace libs {
+const std::set<std::string> SOURCE_EXTENSIONS = {".cpp", ".cc", ".cxx"};
+// Never part of the library itself
+const std::set<std::string> SKIPPED_DIRS = {
+    "build", "test", "tests", "example", "examples", "bench", "benchmark",
+    "benchmarks", "doc", "docs"};
+
+std::filesystem::path lib_cache_dir() {
+    return dreamcpp_home() / "cache" / "lib";
+}
+
+struct DepLib {
+    std::string name;
+    std::filesystem::path root;       // build/deps/<name>
+    std::vector<std::string> sources;
+    std::vector<std::string> flags;   // Everything but the source and output
+    std::vector<std::string> system_libs;
+    std::string archive;              // <lib_dir>/lib<name>.a
+};
+
+// A dreamcpp dep builds like a project (src/*.cpp, minus the app's
+// main.cpp), anything else builds every source under src/, or the whole
+// repo when there's no src/
+std::vector<std::string> find_sources(const std::filesystem::path &root,
+                                      bool dreamcpp_project) {
+    std::vector<std::string> sources;
+    auto src = root / "src";
+    if (dreamcpp_project) {
+        if (std::filesystem::is_directory(src)) {
+            for (const auto &entry : std::filesystem::directory_iterator(src)) {
+                if (entry.is_regular_file() &&
+                    entry.path().extension() == ".cpp" &&
+                    entry.path().filename() != "main.cpp")
+                    sources.push_back(entry.path().generic_string());
+            }
+        }
+    } else {
+        auto base = std::filesystem::is_directory(src) ? src : root;
+        for (auto it = std::filesystem::recursive_directory_iterator(base);
+             it != std::filesystem::recursive_directory_iterator(); ++it) {
+            auto filename = it->path().filename().string();
+            if (it->is_directory() &&
+                (filename.starts_with('.') || SKIPPED_DIRS.contains(filename))) {
+                it.disable_recursion_pending();
+            } else if (it->is_regular_file() &&
+                       SOURCE_EXTENSIONS.contains(it->path().extension().string())) {
+                sources.push_back(it->path().generic_string());
+            }
+        }
+    }
+    // The archive (and so the cache) should come out the same every time
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
+
+struct Prepared {
+    std::vector<std::string> include_flags; // For the project's compiles
+    std::vector<std::string> archives;      // For its link line
+    std::vector<std::string> system_libs;   // -l flags the deps asked for
+};
+
+// Builds every non-header-only dep into <lib_dir>/lib<name>.a. Archives are
+// cached in ~/.dreamcpp/cache/lib by commit + compiler + flags, so each one
+// only gets compiled once per machine, not once per project or build.
+// Without `use_cache` they're built in <lib_dir>/obj/<name> and stay there:
+// PGO's counters are written next to the objects, and its flags name
+// profile data the key knows nothing about.
+std::optional<Prepared> prepare(const AppConfig &config,
+                                const std::vector<std::string> &target_flags,
+                                const std::filesystem::path &lib_dir,
+                                unsigned max_parallel, bool use_cache = true) {
+    Prepared prepared;
+    std::vector<DepLib> libs;
+    for (const auto &dep : config.deps) {
+        // Header-only deps end up in build/includes, and that's all they need
+        auto root = std::filesystem::path("build/deps") / dep.name;
+        if (dep.system || !std::filesystem::is_directory(root) ||
+            std::filesystem::is_directory("build/includes/" + dep.name))
+            continue;
+
+        DepLib lib{dep.name, root, {}, {}, {}, ""};
+        auto dep_config_path = root / "dreamcpp.toml";
+        bool dreamcpp_project = std::filesystem::exists(dep_config_path);
+        std::string standard = config.standard;
+        std::vector<std::string> includes = {"include", "src"};
+        if (dreamcpp_project) {
+            auto dep_config =
+                parse_config_file(dep_config_path.string(), dep.name);
+            if (!dep_config.has_value())
+                return std::nullopt;
+            standard = dep_config->standard;
+            includes.insert(includes.end(), dep_config->includes.begin(),
+                            dep_config->includes.end());
+            for (const auto &sub : dep_config->deps) {
+                if (sub.system)
+                    lib.system_libs.push_back("-l" + sub.name);
+            }
+        }
+
+        lib.flags = {"-std=" + standard, "-Ibuild/includes"};
+        for (const auto &include : includes) {
+            if (std::filesystem::is_directory(root / include))
+                lib.flags.push_back("-I" + (root / include).generic_string());
+        }
+        lib.flags.insert(lib.flags.end(), target_flags.begin(),
+                         target_flags.end());
+
+        if (std::filesystem::is_directory(root / "include"))
+            prepared.include_flags.push_back(
+                "-I" + (root / "include").generic_string());
+        prepared.system_libs.insert(prepared.system_libs.end(),
+                                    lib.system_libs.begin(),
+                                    lib.system_libs.end());
+
+        lib.archive = (lib_dir / std::format("lib{}.a", dep.name)).generic_string();
+        lib.sources = find_sources(root, dreamcpp_project);
+        if (lib.sources.empty()) {
+            // Nothing to compile, maybe it's header-only without saying so
+            spdlog::debug("[⚒️] '{}' has no sources, not building a library",
+                          dep.name);
+            continue;
+        }
+        prepared.archives.push_back(lib.archive);
+        libs.push_back(std::move(lib));
+    }
+    if (libs.empty())
+        return prepared;
+
+    std::filesystem::create_directories(lib_dir);
+    // The stamp next to each archive says what it was built from, the
+    // compiler's version included so an upgrade rebuilds it
+    auto identity = cache::compiler_identity(config.preferred_compiler);
+    std::vector<DepLib *> missing;
+    std::vector<std::string> keys(libs.size());
+    for (size_t i = 0; i < libs.size(); ++i) {
+        auto &lib = libs[i];
+        std::string stamp = std::format(
+            "dreamcpp-lib 2\n{}\n{}\n{}\n{}\n", lib.name,
+            git_head_revision(lib.root), config.preferred_compiler, identity);
+        for (const auto &flag : lib.flags) {
+            stamp += flag + "\n";
+        }
+        keys[i] = stamp;
+        std::ifstream existing(lib.archive + ".stamp");
+        std::string previous((std::istreambuf_iterator<char>(existing)),
+                             std::istreambuf_iterator<char>());
+        if (previous != stamp || !std::filesystem::exists(lib.archive))
+            missing.push_back(&lib);
+    }
+    if (missing.empty())
+        return prepared;
+
+    trace::Scope span("build dependencies", "build");
+    // Archives that aren't in the shared cache get built there first, each
+    // source as its own job so big deps don't serialise the build
+    struct Pending {
+        DepLib *lib;
+        std::filesystem::path cached; // Archive in the shared cache, if used
+        std::filesystem::path work;   // Objects go here while building
+        int lock_fd = -1;             // Held while building it
+    };
+    std::vector<std::pair<std::string, DepLib *>> by_key;
+    for (auto *lib : missing) {
+        by_key.emplace_back(Sha256().update(keys[lib - libs.data()]).hex(), lib);
+    }
+    // Other builds (say, workspace members sharing this dep) wait for
+    // whoever started building an archive first instead of building it
+    // again. Taking the locks in key order means nobody waits in a cycle.
+    std::sort(by_key.begin(), by_key.end());
+    std::filesystem::create_directories(lib_cache_dir());
+    std::vector<Pending> pending;
+    std::vector<Job> jobs;
+    for (const auto &[key, lib] : by_key) {
+        auto cached = lib_cache_dir() / key / std::format("lib{}.a", lib->name);
+        int lock_fd = -1;
+        if (!use_cache) {
+            cached.clear();
+        } else if (!std::filesystem::exists(cached)) {
+            lock_fd = open((lib_cache_dir() / (key + ".lock")).c_str(),
+                           O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (lock_fd >= 0)
+                flock(lock_fd, LOCK_EX);
+        }
+        if (use_cache && std::filesystem::exists(cached)) {
+            if (lock_fd >= 0)
+                close(lock_fd);
+            pending.push_back({lib, cached, {}});
+            continue;
+        }
+        auto work = use_cache ? lib_cache_dir() /
+                                    std::format("{}.tmp-{}", key, getpid())
+                              : lib_dir / "obj" / lib->name;
+        std::filesystem::create_directories(work);
+        pending.push_back({lib, cached, work, lock_fd});
+        spdlog::info("[⚒️] Building dependency '{}' ({} sources)", lib->name,
+                     lib->sources.size());
+        for (size_t s = 0; s < lib->sources.size(); ++s) {
+            std::vector<std::string> cmd = {config.preferred_compiler};
+            cmd.insert(cmd.end(), lib->flags.begin(), lib->flags.end());
+            cmd.insert(cmd.end(),
+                       {"-c", lib->sources[s], "-o",
+                        (work / std::format("{}.o", s)).string()});
+            auto compile = [cmd, source = lib->sources[s]](JobLog &log) {
+                trace::Scope span("compile " + source, "compile");
+                log.info("[⚒️] Compiling {}", source);
+                auto out = process::run(cmd);
+                if (out.exit_code != 0) {
+                    log.error("[⚒️] ❌ Failed to compile {}.", source);
+                    log.error("[⚒️] ❌ {}", out.output);
+                    return false;
+                }
+                return true;
+            };
+            jobs.push_back({lib->sources[s], compile});
+        }
+    }
+
+    bool success = run_jobs(jobs, max_parallel);
+    for (const auto &[lib, cached, work, lock_fd] : pending) {
+        std::error_code ec;
+        if (success && !work.empty()) {
+            auto archive = cached.empty() ? std::filesystem::path(lib->archive)
+                                          : work / cached.filename();
+            std::filesystem::remove(archive, ec); // ar adds to what's there
+            std::vector<std::string> ar_cmd = {"ar", "rcs", archive.string()};
+            for (size_t s = 0; s < lib->sources.size(); ++s) {
+                ar_cmd.push_back((work / std::format("{}.o", s)).string());
+            }
+            auto out = process::run(ar_cmd);
+            if (out.exit_code != 0) {
+                spdlog::error("[⚒️] ❌ Failed to archive '{}': {}", lib->name,
+                              out.output);
+                success = false;
+            } else if (!cached.empty()) {
+                // Renaming the whole dir means a half-built archive is never
+                // visible to other builds
+                for (size_t s = 0; s < lib->sources.size(); ++s) {
+                    std::filesystem::remove(work / std::format("{}.o", s), ec);
+                }
+                std::filesystem::rename(work, cached.parent_path(), ec);
+            }
+        }
+        if (!work.empty() && !cached.empty())
+            std::filesystem::remove_all(work, ec);
+        // The lock file stays: removing it could let a third build lock a
+        // new one while a second still waits on this one
+        if (lock_fd >= 0)
+            close(lock_fd);
+        if (!success)
+            continue;
+
+        if (!cached.empty())
+            std::filesystem::copy_file(
+                cached, lib->archive,
+                std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            spdlog::error("[⚒️] ❌ Couldn't copy the library for '{}': {}",
+                          lib->name, ec.message());
+            success = false;
+            continue;
+        }
+        std::ofstream(lib->archive + ".stamp")
+            << keys[lib - libs.data()];
+    }
+    if (!success) {
+        spdlog::error("[⚒️] ❌ Failed to build dependencies.");
+        return std::nullopt;
+    }
+    return prepared;
+}
+} // namespace libs
+
+// `dreamcpp worker` compiles preprocessed sources sent to it over a socket,
+// and build() can spread its compile jobs over a list of workers. Messages
+// are lists of frames, each an 8-byte little-endian length and then that
+// many bytes:
+//
+//   worker -> client, on connect: "dreamcpp-worker 1", <slots>
+//   client -> worker: "compile", <compiler>, <identity>, <source name>,
+//                     <flags, \0-separated>, <preprocessed source>
+//   worker -> client: "ok" | "failed" | "refused", <diagnostics>, <object>
+//
+// <identity> is the SHA-256 of the client's compiler --version, so a worker
+// with a different compiler refuses instead of producing objects that don't
+// match what the cache (or the rest of the build) expects.
+namespace remote {
+const std::string GREETING = "dreamcpp-worker 1";
+const uint64_t MAX_FRAME = 1ull << 30;
+// A preprocessed source past this is someone filling our memory up
+const uint64_t MAX_REQUEST = 256ull << 20;
+const int CONNECT_TIMEOUT_MS = 3000;
+// -f options that read or write a file of their own, or load a program
+const std::vector<std::string_view> FILE_OPTIONS = {
+    "-fplugin",
+    "-fpass-plugin",
+    "-fprofile",
+    "-fauto-profile",
+    "-fcoverage",
+    "-fdump",
+    "-fopt-info",
+    "-ftime-trace",
+    "-fsave-optimization-record",
+    "-foptimization-record",
+    "-fcrash-diagnostics",
+    "-fmodule",
+    "-fprebuilt-module",
+    "-fcallgraph-info",
+    "-fstack-usage",
+    "-fsanitize-blacklist",
+    "-fsanitize-ignorelist",
+    "-fsanitize-coverage-allowlist",
+    "-fsanitize-coverage-ignorelist",
+    "-fxray-attr-list",
+    "-fxray-always-instrument",
+    "-fxray-never-instrument",
+    "-fdiagnostics-add-output",
+    "-fdiagnostics-set-output",
+    "-fdiagnostics-format",
+    "-fproc-stat-report",
+    "-fembed-offload-object",
+    "-fuse-ld",
+    "-fdebug-compilation-dir",
+    "-frecord-command-line",
+};
+
+// The only flags a worker passes to its compiler: they change the code that
+// comes out, never which files get read or written or what else runs
+bool allowed_flag(std::string_view flag) {
+    // No paths, and nothing that could split into several arguments
+    if (!std::all_of(flag.begin(), flag.end(), [](unsigned char c) {
+            return std::isalnum(c) ||
+                   std::string_view("-_=+.,").find(c) != std::string_view::npos;
+        }))
+        return false;
+    if (flag.starts_with("-std="))
+        return true;
+    if (flag.starts_with("-O") || flag.starts_with("-g") ||
+        flag.starts_with("-m"))
+        return flag.find(',') == std::string_view::npos;
+    // -Wa, -Wp, and -Wl, hand the rest to the assembler, preprocessor, linker
+    if (flag.starts_with("-W"))
+        return flag.size() > 2 && flag.find(',') == std::string_view::npos;
+    if (flag.starts_with("-f"))
+        return std::none_of(
+            FILE_OPTIONS.begin(), FILE_OPTIONS.end(),
+            [&](std::string_view option) { return flag.starts_with(option); });
+    return flag == "-pthread" || flag == "-pedantic" ||
+           flag == "-pedantic-errors" || flag == "-w";
+}
+
+// "unix:/path/to.sock", "tcp:host:port" or just "host:port"
+struct Endpoint {
+    std::string spec;
+    bool unix_socket = false;
+    std::string host; // Or the socket's path
+    std::string port;
+};
+
+std::optional<Endpoint> parse_endpoint(const std::string &spec) {
+    if (spec.starts_with("unix:") && spec.size() > 5)
+        return Endpoint{spec, true, spec.substr(5), ""};
+    auto rest = spec.starts_with("tcp:") ? spec.substr(4) : spec;
+    auto colon = rest.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == rest.size()) {
+        spdlog::error("[⚒️] ❌ '{}' isn't unix:<path>, tcp:<host>:<port> or "
+                      "<host>:<port>",
+                      spec);
+        return std::nullopt;
+    }
+    return Endpoint{spec, false, rest.substr(0, colon), rest.substr(colon + 1)};
+}
+
+// Runs `use` on each address the endpoint resolves to until it returns a
+// socket. The callback gets a fresh socket and owns it.
+int with_addresses(const Endpoint &endpoint,
+                   const std::function<int(int, const sockaddr *, socklen_t)> &use) {
+    if (endpoint.unix_socket) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (endpoint.host.size() >= sizeof(addr.sun_path))
+            return -1;
+        std::memcpy(addr.sun_path, endpoint.host.c_str(), endpoint.host.size());
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        return fd < 0 ? -1 : use(fd, (sockaddr *)&addr, sizeof(addr));
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if (getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints,
+                    &found) != 0)
+        return -1;
+    int result = -1;
+    for (auto *info = found; info && result < 0; info = info->ai_next) {
+        int fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC,
+                        info->ai_protocol);
+        if (fd >= 0)
+            result = use(fd, info->ai_addr, info->ai_addrlen);
+    }
+    freeaddrinfo(found);
+    return result;
+}
+
+bool send_frames(int fd, const std::vector<std::string> &frames) {
+    std::string out;
+    for (const auto &frame : frames) {
+        uint64_t size = frame.size();
+        for (int i = 0; i < 8; ++i) {
+            out.push_back((char)((size >> (8 * i)) & 0xff));
+        }
+        out += frame;
+    }
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool recv_exact(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// `max_total` caps all the frames together, checked before allocating any
+std::optional<std::vector<std::string>>
+recv_frames(int fd, size_t count, uint64_t max_total = MAX_FRAME) {
+    std::vector<std::string> frames(count);
+    uint64_t total = 0;
+    for (auto &frame : frames) {
+        unsigned char header[8];
+        if (!recv_exact(fd, (char *)header, sizeof(header)))
+            return std::nullopt;
+        uint64_t size = 0;
+        for (int i = 7; i >= 0; --i) {
+            size = (size << 8) | header[i];
+        }
+        if (size > MAX_FRAME || size > max_total - total)
+            return std::nullopt;
+        total += size;
+        frame.resize(size);
+        if (!recv_exact(fd, frame.data(), size))
+            return std::nullopt;
+    }
+    return frames;
+}
+
+// "a,b,c" as given to --workers or in DREAMCPP_WORKERS
+std::vector<std::string> split_list(const char *list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list ? list : "");
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<std::string> split_flags(const std::string &joined) {
+    std::vector<std::string> flags;
+    std::stringstream stream(joined);
+    std::string flag;
+    while (std::getline(stream, flag, '\0')) {
+        if (!flag.empty())
+            flags.push_back(flag);
+    }
+    return flags;
+}
+
+// What's left of the compile flags once the source is preprocessed: include
+// paths, macros and forced includes already did their job
+std::vector<std::string> codegen_only(const std::vector<std::string> &flags) {
+    const std::set<std::string> with_argument = {"-include", "-isystem",
+                                                 "-iquote", "-imacros"};
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < flags.size(); ++i) {
+        const auto &flag = flags[i];
+        if (with_argument.contains(flag)) {
+            ++i;
+            continue;
+        }
+        // The prefix map names our dir, workers map their own instead
+        if (flag.starts_with("-I") || flag.starts_with("-D") ||
+            flag.starts_with("-U") || flag.starts_with("-fmodule") ||
+            flag.starts_with("-ffile-prefix-map="))
+            continue;
+        kept.push_back(flag);
+    }
+    return kept;
+}
+
+namespace worker {
+struct Options {
+    std::string listen = "tcp:127.0.0.1:7800";
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> compilers = {"c++", "g++", "clang++"};
+};
+
+std::atomic<uint64_t> next_job = 0;
+
+// Compiles one request in a scratch dir, returns the reply frames
+std::vector<std::string> compile(const Options &options,
+                                 const std::vector<std::string> &request,
+                                 std::counting_semaphore<> &slots) {
+    const auto &compiler = request[1];
+    auto flags = split_flags(request[4]);
+    if (std::find(options.compilers.begin(), options.compilers.end(),
+                  compiler) == options.compilers.end())
+        return {"refused", std::format("'{}' isn't an allowed compiler",
+                                       compiler), ""};
+    for (const auto &flag : flags) {
+        if (!allowed_flag(flag))
+            return {"refused", std::format("'{}' isn't allowed", flag), ""};
+    }
+    if (Sha256().update(cache::compiler_identity(compiler)).hex() != request[2])
+        return {"refused", std::format("this worker's {} is a different "
+                                       "version",
+                                       compiler),
+                ""};
+
+    slots.acquire();
+    auto dir = std::filesystem::temp_directory_path() /
+               std::format("dreamcpp-worker-{}-{}", getpid(), next_job++);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::vector<std::string> reply;
+    if (write_if_changed(dir / "source.ii", request[5])) {
+        std::vector<std::string> cmd = {compiler};
+        cmd.insert(cmd.end(), flags.begin(), flags.end());
+        // So debug info says "." like a local compile's, not the scratch dir
+        cmd.push_back(std::format("-ffile-prefix-map={}=.", dir.string()));
+        cmd.insert(cmd.end(), {"-c", (dir / "source.ii").string(), "-o",
+                               (dir / "source.o").string()});
+        trace::Scope span("compile " + request[3], "compile");
+        // Anything the compiler drops in its cwd goes with the scratch dir
+        auto out = process::run(cmd, process::Output::Capture, dir);
+        std::ifstream object(dir / "source.o", std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(object)),
+                          std::istreambuf_iterator<char>());
+        reply = {out.exit_code == 0 ? "ok" : "failed", out.output, bytes};
+    } else {
+        reply = {"refused", "couldn't write the source to " + dir.string(), ""};
+    }
+    slots.release();
+    std::filesystem::remove_all(dir, ec);
+    return reply;
+}
+
+// Serves one client until it hangs up
+void serve_connection(int fd, const Options &options,
+                      std::counting_semaphore<> &slots) {
+    if (send_frames(fd, {GREETING, std::to_string(options.jobs)})) {
+        while (auto request = recv_frames(fd, 6, MAX_REQUEST)) {
+            if ((*request)[0] != "compile")
+                break;
+            spdlog::info("[👷] Compiling {}", (*request)[3]);
+            auto reply = compile(options, *request, slots);
+            if (reply[0] == "refused")
+                spdlog::warn("[👷] ⚠️ Refused {}: {}", (*request)[3], reply[1]);
+            if (!send_frames(fd, reply))
+                break;
+        }
+    }
+    close(fd);
+}
+
+bool run(const Options &options) {
+    auto endpoint = parse_endpoint(options.listen);
+    if (!endpoint.has_value())
+        return false;
+    if (endpoint->unix_socket)
+        std::filesystem::remove(endpoint->host); // Left by an earlier worker
+    int listener = with_addresses(
+        *endpoint, [](int fd, const sockaddr *addr, socklen_t size) {
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            if (bind(fd, addr, size) == 0 && listen(fd, 64) == 0)
+                return fd;
+            close(fd);
+            return -1;
+        });
+    if (listener < 0) {
+        spdlog::error("[👷] ❌ Couldn't listen on {}: {}", options.listen,
+                      strerror(errno));
+        return false;
+    }
+    if (!endpoint->unix_socket && endpoint->host != "127.0.0.1" &&
+        endpoint->host != "localhost" && endpoint->host != "::1")
+        spdlog::warn("[👷] ⚠️ Anyone who can reach {} can run {} here",
+                     options.listen, join(options.compilers, ", "));
+    spdlog::info("[👷] ✅ Listening on {} with {} slots", options.listen,
+                 options.jobs);
+
+    // Connections past the slot count just queue up for a slot
+    static std::counting_semaphore<> slots(options.jobs);
+    while (true) {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            spdlog::error("[👷] ❌ accept() failed: {}", strerror(errno));
+            close(listener);
+            return false;
+        }
+        std::thread(serve_connection, fd, std::cref(options), std::ref(slots))
+            .detach();
+    }
+}
+} // namespace worker
+
+struct Request {
+    std::string compiler;
+    std::string identity; // SHA-256 of its --version
+    std::string source;
+    std::vector<std::string> flags;
+    std::string preprocessed;
+};
+
+// The workers one build() spreads its compiles over. Each compile takes a
+// free slot, a worker's (as many as it said it has) before a local one
+// (`local_slots` of them), and waits when there are none: that's the
+// backpressure that stops a build from queueing everything on one worker.
+class Pool {
+  public:
+    Pool(const std::vector<std::string> &specs, unsigned local_slots)
+        : local_free(std::max(1u, local_slots)) {
+        for (const auto &spec : specs) {
+            auto endpoint = parse_endpoint(spec);
+            if (!endpoint.has_value())
+                continue;
+            Worker worker;
+            worker.endpoint = *endpoint;
+            int slots = 0;
+            int fd = connect(worker.endpoint, slots);
+            if (fd < 0) {
+                spdlog::warn("[⚒️] ⚠️ Worker {} is unreachable, compiling "
+                             "without it",
+                             spec);
+                continue;
+            }
+            worker.slots = slots;
+            worker.idle.push_back(fd);
+            workers.push_back(std::move(worker));
+        }
+    }
+
+    ~Pool() {
+        for (auto &worker : workers) {
+            for (int fd : worker.idle) {
+                close(fd);
+            }
+        }
+    }
+
+    // Every slot across the reachable workers and this machine
+    unsigned total_slots() const {
+        unsigned total = local_free;
+        for (const auto &worker : workers) {
+            total += worker.slots;
+        }
+        return total;
+    }
+
+    bool empty() const { return workers.empty(); }
+
+    // Compiles `request` on a worker when one is free, and with `local` when
+    // a local slot is free first, there's no request (it can't be sent), or
+    // the worker couldn't do it. Writes the object to `object` either way.
+    ExecResult compile(const std::string &source,
+                       const std::optional<Request> &request,
+                       const std::string &object,
+                       const std::function<ExecResult()> &local, JobLog &log) {
+        int w = acquire(request.has_value());
+        if (w >= 0) {
+            auto name = workers[w].endpoint.spec;
+            auto result = compile_on(w, *request, object);
+            if (result.has_value()) {
+                log.info("[⚒️] Compiling {} (on {})", source, name);
+                return *result;
+            }
+            log.warn("[⚒️] ⚠️ {} couldn't compile {}, compiling it here",
+                     name, source);
+            w = acquire(false);
+        }
+        log.info("[⚒️] Compiling {}", source);
+        auto result = local();
+        release(w);
+        return result;
+    }
+
+  private:
+    struct Worker {
+        Endpoint endpoint;
+        unsigned slots = 0;
+        std::vector<int> idle; // Open connections nobody is using
+        unsigned busy = 0;
+        bool down = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<Worker> workers;
+    unsigned local_free;
+
+    // Connects and reads the greeting, -1 if that didn't work out
+    static int connect(const Endpoint &endpoint, int &slots) {
+        // Non-blocking, so an unreachable worker costs seconds rather than
+        // the kernel's SYN timeout
+        int fd = with_addresses(
+            endpoint, [](int fd, const sockaddr *addr, socklen_t size) {
+                int flags = fcntl(fd, F_GETFL);
+                fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+                int rc = ::connect(fd, addr, size);
+                if (rc != 0 && errno == EINPROGRESS) {
+                    pollfd pfd = {fd, POLLOUT, 0};
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) == 1 &&
+                        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+                        err == 0)
+                        rc = 0;
+                }
+                if (rc == 0 && fcntl(fd, F_SETFL, flags) == 0)
+                    return fd;
+                close(fd);
+                return -1;
+            });
+        if (fd < 0)
+            return -1;
+        // The greeting comes right away from a live worker
+        timeval timeout = {CONNECT_TIMEOUT_MS / 1000, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        auto greeting = recv_frames(fd, 2, 4096);
+        if (!greeting.has_value() || (*greeting)[0] != GREETING) {
+            close(fd);
+            return -1;
+        }
+        slots = std::max(1, std::atoi((*greeting)[1].c_str()));
+        // A worker that stops answering is as good as down
+        timeout = {300, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return fd;
+    }
+
+    // A worker's index, or -1 for a local slot
+    int acquire(bool remote_ok) {
+        std::unique_lock lock(mutex);
+        while (true) {
+            for (size_t w = 0; remote_ok && w < workers.size(); ++w) {
+                if (!workers[w].down && workers[w].busy < workers[w].slots) {
+                    ++workers[w].busy;
+                    return (int)w;
+                }
+            }
+            if (local_free > 0) {
+                --local_free;
+                return -1;
+            }
+            ready.wait(lock);
+        }
+    }
+
+    void release(int w, int fd = -1) {
+        {
+            std::lock_guard lock(mutex);
+            if (w < 0) {
+                ++local_free;
+            } else {
+                --workers[w].busy;
+                if (fd >= 0)
+                    workers[w].idle.push_back(fd);
+            }
+        }
+        ready.notify_all();
+    }
+
+    // Nothing if the worker failed us, it's then left out for the rest of
+    // the build. A compile error comes back like a local one would.
+    std::optional<ExecResult> compile_on(int w, const Request &request,
+                                         const std::string &object) {
+        int fd = -1;
+        {
+            std::lock_guard lock(mutex);
+            if (!workers[w].idle.empty()) {
+                fd = workers[w].idle.back();
+                workers[w].idle.pop_back();
+            }
+        }
+        int slots = 0;
+        if (fd < 0)
+            fd = connect(workers[w].endpoint, slots);
+
+        std::optional<std::vector<std::string>> reply;
+        if (fd >= 0 &&
+            send_frames(fd, {"compile", request.compiler, request.identity,
+                             request.source, join(request.flags, std::string(1, '\0')),
+                             request.preprocessed}))
+            reply = recv_frames(fd, 3);
+
+        bool usable = reply.has_value() && (*reply)[0] != "refused";
+        if (usable && (*reply)[0] == "ok") {
+            // Never leave a truncated object behind for the link to find
+            auto tmp = object + ".remote";
+            std::ofstream file(tmp, std::ios::binary);
+            file << (*reply)[2];
+            file.close();
+            std::error_code ec;
+            if (file.good())
+                std::filesystem::rename(tmp, object, ec);
+            usable = file.good() && !ec;
+            if (!usable)
+                std::filesystem::remove(tmp, ec);
+        }
+        if (!usable) {
+            if (reply.has_value())
+                spdlog::warn("[⚒️] ⚠️ {} refused work: {}",
+                             workers[w].endpoint.spec, (*reply)[1]);
+            if (fd >= 0)
+                close(fd);
+            {
+                std::lock_guard lock(mutex);
+                workers[w].down = true;
+            }
+            release(w);
+            return std::nullopt;
+        }
+        release(w, fd);
+        // Failed compiles come back here too, so the fallback is only ever
+        // for trouble with the worker itself
+        return ExecResult{(*reply)[1], (*reply)[0] == "ok" ? 0 : 1};
+    }
+};
+} // namespace remote
+
+// `build --time-report`: every unit is compiled with clang's -ftime-trace
+// (gcc's -ftime-report, which only has phases), and the traces are added up
+// across units to show which headers, templates and functions the build
+// spends its time on.
+namespace time_report {
+// Just enough JSON for the traces clang writes
+struct Json {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    const Json *get(std::string_view key) const {
+        for (const auto &[name, value] : members) {
+            if (name == key)
+                return &value;
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+  public:
+    explicit JsonParser(std::string_view text) : text(text) {}
+
+    std::optional<Json> parse() {
+        auto value = parse_value(0);
+        skip_space();
+        if (!value.has_value() || pos != text.size())
+            return std::nullopt;
+        return value;
+    }
+
+  private:
+    std::string_view text;
+    size_t pos = 0;
+
+    void skip_space() {
+        while (pos < text.size() &&
+               (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' ||
+                text[pos] == '\r'))
+            ++pos;
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(std::string_view word) {
+        if (text.substr(pos, word.size()) != word)
+            return false;
+        pos += word.size();
+        return true;
+    }
+
+    std::optional<Json> parse_value(unsigned depth) {
+        skip_space();
+        if (pos >= text.size() || depth > 256)
+            return std::nullopt;
+        Json value;
+        if (consume('{')) {
+            value.type = Json::Type::Object;
+            if (consume('}'))
+                return value;
+            do {
+                skip_space();
+                auto key = parse_string();
+                if (!key.has_value() || !consume(':'))
+                    return std::nullopt;
+                auto member = parse_value(depth + 1);
+                if (!member.has_value())
+                    return std::nullopt;
+                value.members.emplace_back(std::move(*key), std::move(*member));
+            } while (consume(','));
+            if (!consume('}'))
+                return std::nullopt;
+        } else if (consume('[')) {
+            value.type = Json::Type::Array;
+            if (consume(']'))
+                return value;
+            do {
+                auto item = parse_value(depth + 1);
+                if (!item.has_value())
+                    return std::nullopt;
+                value.items.push_back(std::move(*item));
+            } while (consume(','));
+            if (!consume(']'))
+                return std::nullopt;
+        } else if (text[pos] == '"') {
+            auto str = parse_string();
+            if (!str.has_value())
+                return std::nullopt;
+            value.type = Json::Type::String;
+            value.string = std::move(*str);
+        } else if (literal("true") || literal("false")) {
+            value.type = Json::Type::Bool;
+            value.boolean = text[pos - 1] == 'e' && text[pos - 2] == 'u';
+        } else if (literal("null")) {
+            value.type = Json::Type::Null;
+        } else {
+            auto [end, ec] = std::from_chars(text.data() + pos,
+                                             text.data() + text.size(),
+                                             value.number);
+            if (ec != std::errc())
+                return std::nullopt;
+            value.type = Json::Type::Number;
+            pos = end - text.data();
+        }
+        return value;
+    }
+
+    std::optional<std::string> parse_string() {
+        if (pos >= text.size() || text[pos] != '"')
+            return std::nullopt;
+        ++pos;
+        std::string out;
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"')
+                return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size())
+                break;
+            switch (char escaped = text[pos++]) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                auto code = hex4();
+                if (!code.has_value())
+                    return std::nullopt;
+                // A surrogate pair is two escapes for one code point
+                if (*code >= 0xd800 && *code < 0xdc00 &&
+                    text.substr(pos, 2) == "\\u") {
+                    pos += 2;
+                    auto low = hex4();
+                    if (!low.has_value())
+                        return std::nullopt;
+                    *code = 0x10000 + ((*code - 0xd800) << 10) + (*low - 0xdc00);
+                }
+                append_utf8(out, *code);
+                break;
+            }
+            default: out += escaped; // \" \\ and \/
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<uint32_t> hex4() {
+        if (pos + 4 > text.size())
+            return std::nullopt;
+        uint32_t code = 0;
+        auto [end, ec] =
+            std::from_chars(text.data() + pos, text.data() + pos + 4, code, 16);
+        if (ec != std::errc() || end != text.data() + pos + 4)
+            return std::nullopt;
+        pos += 4;
+        return code;
+    }
+
+    static void append_utf8(std::string &out, uint32_t code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        } else {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+};
+
+struct Stat {
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+    unsigned count = 0;
+
+    void add(int64_t us) {
+        total_us += us;
+        max_us = std::max(max_us, us);
+        ++count;
+    }
+};
+
+struct UnitTimes {
+    std::string source;
+    int64_t total_us = 0;
+    int64_t frontend_us = 0; // Parsing and instantiating
+    int64_t backend_us = 0;  // Optimising and generating code
+};
+
+struct Report {
+    std::vector<UnitTimes> units;
+    // Times are inclusive: a header's includes count towards it too
+    std::map<std::string, Stat> headers;
+    std::map<std::string, Stat> templates;
+    std::map<std::string, Stat> functions;
+    std::map<std::string, Stat> phases; // gcc's, which has nothing finer
+};
+
+// Where each compiler leaves its report for `object`
+std::filesystem::path trace_path(const std::string &object, bool clang) {
+    return std::filesystem::path(object).replace_extension(
+        clang ? ".json" : ".time-report");
+}
+
+// Adds one -ftime-trace file to `report`
+bool add_trace(Report &report, UnitTimes &unit, const std::string &contents) {
+    auto json = JsonParser(contents).parse();
+    const Json *events = json ? json->get("traceEvents") : nullptr;
+    if (!events)
+        return false;
+    for (const auto &event : events->items) {
+        const Json *name = event.get("name");
+        const Json *dur = event.get("dur");
+        if (!name || !dur || name->string.starts_with("Total "))
+            continue; // Those are clang's own per-unit sums
+        auto us = (int64_t)dur->number;
+        const Json *args = event.get("args");
+        const Json *detail = args ? args->get("detail") : nullptr;
+        const auto &what = name->string;
+        if (what == "ExecuteCompiler") {
+            unit.total_us += us;
+        } else if (what == "Frontend") {
+            unit.frontend_us += us;
+        } else if (what == "Backend") {
+            unit.backend_us += us;
+        } else if (!detail) {
+            continue;
+        } else if (what == "Source") {
+            report.headers[std::filesystem::path(detail->string)
+                               .lexically_normal()
+                               .string()]
+                .add(us);
+        } else if (what == "InstantiateClass" || what == "InstantiateFunction") {
+            report.templates[detail->string].add(us);
+        } else if (what == "CodeGen Function" || what == "OptFunction") {
+            report.functions[detail->string].add(us);
+        }
+    }
+    return true;
+}
+
+// Adds one -ftime-report table to `report`, by wall time
+bool add_gcc_report(Report &report, UnitTimes &unit,
+                    const std::string &contents) {
+    std::istringstream lines(contents);
+    std::string line;
+    bool found = false;
+    while (std::getline(lines, line)) {
+        auto colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        auto name = line.substr(0, colon);
+        name.erase(0, name.find_first_not_of(" |"));
+        name.erase(name.find_last_not_of(' ') + 1);
+        // usr, sys, wall, GGC; each but the last with a "( 12%)" after it
+        std::string numbers;
+        for (size_t i = colon + 1, depth = 0; i < line.size(); ++i) {
+            depth += line[i] == '(';
+            if (depth == 0)
+                numbers += line[i];
+            depth -= line[i] == ')' && depth > 0;
+        }
+        std::istringstream fields(numbers);
+        double usr = 0, sys = 0, wall = 0;
+        if (!(fields >> usr >> sys >> wall))
+            continue;
+        auto us = (int64_t)(wall * 1e6);
+        found = true;
+        if (name == "TOTAL") {
+            unit.total_us += us;
+        } else if (name == "phase parsing" || name == "phase lang. deferred") {
+            unit.frontend_us += us;
+        } else if (name == "phase opt and generate") {
+            unit.backend_us += us;
+        } else if (!name.starts_with("phase ")) {
+            report.phases[name].add(us);
+        }
+    }
+    return found;
+}
+
+// The top `count` of `stats` by total time
+std::vector<std::pair<std::string, Stat>>
+top(const std::map<std::string, Stat> &stats, size_t count) {
+    std::vector<std::pair<std::string, Stat>> sorted(stats.begin(),
+                                                     stats.end());
+    count = std::min(count, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(),
+                      [](const auto &a, const auto &b) {
+                          return a.second.total_us > b.second.total_us;
+                      });
+    sorted.resize(count);
+    return sorted;
+}
+
+std::string to_json(const Report &report, const std::string &compiler) {
+    auto stats = [](const std::map<std::string, Stat> &stats) {
+        std::string out = "[";
+        for (size_t i = 0; const auto &[name, stat] : top(stats, 100)) {
+            out += std::format("{}\n    {{\"name\":\"{}\",\"total_ms\":{:.3f},"
+                               "\"max_ms\":{:.3f},\"count\":{}}}",
+                               i++ ? "," : "", json_escape(name),
+                               stat.total_us / 1000.0, stat.max_us / 1000.0,
+                               stat.count);
+        }
+        return out + "]";
+    };
+    std::string units = "[";
+    for (size_t i = 0; const auto &unit : report.units) {
+        units += std::format("{}\n    {{\"source\":\"{}\",\"total_ms\":{:.3f},"
+                             "\"frontend_ms\":{:.3f},\"backend_ms\":{:.3f}}}",
+                             i++ ? "," : "", json_escape(unit.source),
+                             unit.total_us / 1000.0, unit.frontend_us / 1000.0,
+                             unit.backend_us / 1000.0);
+    }
+    units += "]";
+    return std::format("{{\n  \"compiler\":\"{}\",\n  \"units\":{},\n"
+                       "  \"headers\":{},\n  \"templates\":{},\n"
+                       "  \"functions\":{},\n  \"phases\":{}\n}}\n",
+                       json_escape(compiler), units, stats(report.headers),
+                       stats(report.templates), stats(report.functions),
+                       stats(report.phases));
+}
+
+void print_top(const std::string &title,
+               const std::map<std::string, Stat> &stats, size_t count) {
+    if (stats.empty())
+        return;
+    spdlog::info("[⏱️] {}:", title);
+    for (const auto &[name, stat] : top(stats, count)) {
+        spdlog::info("[⏱️] {:>9.1f}ms {:>5}x  {}", stat.total_us / 1000.0,
+                     stat.count, name);
+    }
+}
+
+// Reads the report each unit's compile left behind (up-to-date units keep
+// theirs from the build that compiled them), prints where the time went and
+// writes it all to `summary_path`
+bool summarize(const std::vector<std::pair<std::string, std::string>> &units,
+               const std::string &compiler, bool clang,
+               const std::filesystem::path &summary_path, size_t count = 10) {
+    Report report;
+    for (const auto &[source, object] : units) {
+        std::ifstream file(trace_path(object, clang), std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+        UnitTimes unit{source};
+        if (!file.is_open() || !(clang ? add_trace(report, unit, contents)
+                                       : add_gcc_report(report, unit, contents))) {
+            spdlog::warn("[⏱️] ⚠️ No usable time report for {}", source);
+            continue;
+        }
+        report.units.push_back(unit);
+    }
+    std::sort(report.units.begin(), report.units.end(),
+              [](const auto &a, const auto &b) { return a.total_us > b.total_us; });
+
+    spdlog::info("[⏱️] Slowest units:");
+    for (size_t i = 0; i < std::min(count, report.units.size()); ++i) {
+        const auto &unit = report.units[i];
+        spdlog::info("[⏱️] {:>9.1f}ms  {} (frontend {:.1f}ms, backend {:.1f}ms)",
+                     unit.total_us / 1000.0, unit.source,
+                     unit.frontend_us / 1000.0, unit.backend_us / 1000.0);
+    }
+    print_top("Costliest headers", report.headers, count);
+    print_top("Costliest template instantiations", report.templates, count);
+    print_top("Costliest functions", report.functions, count);
+    print_top("Costliest compiler phases", report.phases, count);
+    if (!clang)
+        spdlog::info("[⏱️] 💡 gcc only reports phases, build with clang to see "
+                     "headers and templates");
+
+    std::ofstream summary(summary_path);
+    summary << to_json(report, compiler);
+    if (!summary.good()) {
+        spdlog::error("[⏱️] ❌ Couldn't write {}", summary_path.string());
+        return false;
+    }
+    spdlog::info("[⏱️] ✅ Wrote {}", summary_path.string());
+    return true;
+}
+} // namespace time_report
+
+struct BuildOptions {
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool keep_going = false; // Keep compiling other units after a failure
+    bool use_cache = true;   // Share objects through ~/.dreamcpp/cache/obj
+    bool use_pch = true;     // Precompile headers from header-only deps
+    std::string profile = "debug"; // [profiles.<name>] or a built-in one
+    // Used by the --pgo steps
+    std::vector<std::string> extra_flags = {}; // Compile and link flags
+    std::string output_dir = "";               // Instead of the profile's
+    std::optional<unsigned> unity;             // Instead of the profile's
+    // `dreamcpp worker` endpoints to compile on
+    std::vector<std::string> workers =
+        remote::split_list(std::getenv("DREAMCPP_WORKERS"));
+    bool time_report = false; // See namespace time_report
+};
+
+// What `watch` keeps in memory between builds instead of re-reading it
+struct BuildState {
+    std::optional<AppConfig> config; // Reset when dreamcpp.toml changes
+    std::string graph_path;
+    graph::BuildGraph graph; // As the last build saved it
+    // What `dreamcpp test` needs to build against the project's objects
+    std::filesystem::path output_dir;
+    std::vector<std::string> compile_flags;
+    std::vector<std::string> link_inputs; // Everything but src/main.cpp's
+    std::vector<std::string> link_flags;
+};
+
+// Returns the path of the linked binary, or nothing if the build failed
+std::optional<std::string> build(const BuildOptions &options = {},
+                                 BuildState *state = nullptr) {
+    trace::Scope span("build", "build");
+    if (!std::filesystem::exists("dreamcpp.toml")) {
+        spdlog::error("[⚒️] ❌ This... isn't a 🌌++ project.");
+        return std::nullopt;
+    }
+    auto app_config = state && state->config
+                          ? state->config
+                          : parse_config_file(
+                                "dreamcpp.toml",
+                                std::filesystem::current_path()
+                                    .filename()
+                                    .string());
+    if (!app_config.has_value())
+        return std::nullopt;
+    if (state)
+        state->config = app_config;
+    // What sync pulled in for the project's deps builds and links like them
+    for (const auto &name : dependency::required_deps()) {
+        if (std::none_of(app_config->deps.begin(), app_config->deps.end(),
+                         [&](const auto &dep) { return dep.name == name; }))
+            app_config->deps.push_back(Dependency{name});
+    }
+    auto profile = profile::resolve(*app_config, options.profile);
+    if (!profile.has_value())
+        return std::nullopt;
+    spdlog::info("[⚒️] Building this project ({})...", profile->name);
+    std::filesystem::path output_dir =
+        options.output_dir.empty() ? profile->output_dir : options.output_dir;
+    // Its own objects, since the flags differ and it can't use the cache
+    // (a cached object comes without a report)
+    if (options.time_report)
+        output_dir /= "time-report";
+    bool use_cache = options.use_cache && !options.time_report;
+    auto obj_dir = output_dir / "obj";
+    auto graph_path = (obj_dir / graph::GRAPH_FILE).string();
+
+    // Check if src directory exists and has files
+    if (!std::filesystem::exists("src")) {
+        spdlog::error("[⚒️] ❌ No src directory found");
+        return std::nullopt;
+    }
+
+    auto units = collect_translation_units(obj_dir);
+    if (units.empty()) {
+        spdlog::error("[⚒️] ❌ No source files found in src");
+        return std::nullopt;
+    }
+    std::filesystem::create_directories(obj_dir);
+
+    // Named modules: what each source provides and imports, so interfaces
+    // get compiled before anything that imports them
+    auto isolated = unity::load_isolated(obj_dir);
+    auto standalone = isolated;
+    // Tests link everything but main(), so it can't share a batch either
+    standalone.insert(MAIN_SOURCE);
+    std::map<std::string, modules::Info> module_info;
+    for (const auto &tu : units) {
+        auto info = modules::scan(tu.source);
+        if (!info.header_units.empty()) {
+            spdlog::error("[⚒️] ❌ {}: header units (import {}) aren't "
+                          "supported, #include it instead",
+                          tu.source, info.header_units[0]);
+            return std::nullopt;
+        }
+        if (info.uses_modules()) {
+            standalone.insert(tu.source); // Module units can't share a batch
+            module_info[tu.source] = std::move(info);
+        }
+    }
+    bool uses_modules = !module_info.empty();
+
+    // In unity mode every unit is a batch, members[i] are the sources in it
+    auto unity_size = options.unity.value_or(profile->unity);
+    std::vector<std::vector<TranslationUnit>> members;
+    if (unity_size > 1) {
+        auto batches =
+            unity::plan(units, unity_size, standalone, output_dir, obj_dir);
+        units.clear();
+        for (auto &batch : batches) {
+            units.push_back(batch.unit);
+            members.push_back(std::move(batch.members));
+        }
+    } else {
+        for (const auto &tu : units) {
+            members.push_back({tu});
+        }
+    }
+
+    // construct build commands
+    std::vector<std::string> compile_flags = {
+        std::format("-std={}", app_config->standard), "-Ibuild/includes"};
+    for (const auto &include : app_config->includes) {
+        compile_flags.push_back("-I" + include);
+    }
+
+    // Only ask the compiler what it is when the flags depend on it
+    std::vector<std::string> codegen_flags = {"-O" + profile->opt_level};
+    if (profile->lto != "off") {
+        auto lto = profile::lto_flags(
+            *profile, profile::is_clang(app_config->preferred_compiler));
+        codegen_flags.insert(codegen_flags.end(), lto.begin(), lto.end());
+    }
+    codegen_flags.insert(codegen_flags.end(), options.extra_flags.begin(),
+                         options.extra_flags.end());
+
+    // Compiled deps get built with these too, so everything links together
+    std::vector<std::string> target_flags = codegen_flags;
+    if (profile->debug_info)
+        target_flags.push_back("-g");
+    target_flags.insert(target_flags.end(), profile->flags.begin(),
+                        profile->flags.end());
+    compile_flags.insert(compile_flags.end(), target_flags.begin(),
+                         target_flags.end());
+    // Debug info records the dir it was compiled in (DW_AT_comp_dir). As "."
+    // every checkout's objects come out the same and can share the cache,
+    // which is why this one flag stays out of the cache key.
+    std::string prefix_map;
+    if (profile->debug_info) {
+        prefix_map = std::format("-ffile-prefix-map={}=.",
+                                 std::filesystem::current_path().string());
+        compile_flags.push_back(prefix_map);
+    }
+    // Not for deps: their objects go into archives, away from the .dwo files
+    bool split_dwarf = profile->debug_info && profile->split_debug;
+    if (split_dwarf)
+        compile_flags.push_back("-gsplit-dwarf");
+    // The object names its .dwo by absolute path, a cached one would point
+    // gdb at another checkout's
+    if (split_dwarf)
+        use_cache = false;
+    // clang writes its trace next to the object, gcc's report comes out on
+    // stderr and the compile job saves it there
+    bool clang_trace = profile::is_clang(app_config->preferred_compiler);
+    if (options.time_report)
+        compile_flags.push_back(clang_trace ? "-ftime-trace" : "-ftime-report");
+
+    auto dep_libs = libs::prepare(*app_config, target_flags, output_dir / "lib",
+                                  options.jobs, options.use_cache);
+    if (!dep_libs.has_value())
+        return std::nullopt;
+    compile_flags.insert(compile_flags.end(), dep_libs->include_flags.begin(),
+                         dep_libs->include_flags.end());
+
+    // BMIs for the project's own modules live next to its objects, the
+    // standard library's in the shared cache
+    bool clang = uses_modules &&
+                 profile::is_clang(app_config->preferred_compiler);
+    std::map<std::string, std::string> bmis; // Module name -> BMI
+    std::vector<std::string> module_objects; // std modules, for the link
+    if (uses_modules) {
+        std::set<std::string> std_needed;
+        for (const auto &[source, info] : module_info) {
+            for (const auto &name : info.imports) {
+                if (modules::STD_MODULES.contains(name))
+                    std_needed.insert(name);
+            }
+        }
+        std::optional<modules::StdModules> std_modules;
+        if (!std_needed.empty()) {
+            std_modules = modules::prepare_std(app_config->preferred_compiler,
+                                               clang, compile_flags,
+                                               std_needed);
+            if (!std_modules.has_value())
+                return std::nullopt;
+            bmis = std_modules->bmis;
+            module_objects = std_modules->objects;
+        }
+
+        auto bmi_dir = output_dir / "bmi";
+        std::filesystem::create_directories(bmi_dir);
+        for (const auto &[source, info] : module_info) {
+            if (!info.provides.empty())
+                bmis[info.provides] =
+                    (bmi_dir / modules::bmi_name(info.provides, clang))
+                        .generic_string();
+        }
+        if (clang) {
+            compile_flags.push_back("-fprebuilt-module-path=" +
+                                    bmi_dir.generic_string());
+            if (std_modules.has_value())
+                compile_flags.push_back("-fprebuilt-module-path=" +
+                                        std_modules->dir.string());
+        } else {
+            // gcc finds BMIs through a mapper file rather than a directory
+            std::string mapper = "$root .\n";
+            for (const auto &[name, bmi] : bmis) {
+                mapper += std::format("{} {}\n", name, bmi);
+            }
+            auto mapper_path = (bmi_dir / "module.map").generic_string();
+            write_if_changed(mapper_path, mapper);
+            compile_flags.insert(compile_flags.end(),
+                                 {"-fmodules-ts",
+                                  "-fmodule-mapper=" + mapper_path});
+        }
+    }
+
+    // Imports already skip re-parsing headers, and gcc won't mix the two
+    if (options.use_pch && !uses_modules) {
+        if (auto header =
+                pch::prepare(*app_config, compile_flags, output_dir / "pch")) {
+            compile_flags.insert(compile_flags.end(), {"-include", *header});
+        }
+    }
+
+    std::vector<std::string> link_flags = {"-Lbuild/lib"};
+    link_flags.insert(link_flags.end(), codegen_flags.begin(),
+                      codegen_flags.end());
+    link_flags.insert(link_flags.end(), profile->link_flags.begin(),
+                      profile->link_flags.end());
+    for (const auto &dep : app_config->deps) {
+        if (dep.system) {
+            link_flags.push_back("-l" + dep.name);
+        }
+    }
+    link_flags.insert(link_flags.end(), dep_libs->system_libs.begin(),
+                      dep_libs->system_libs.end());
+    auto chosen_linker =
+        linker::choose(*profile, app_config->preferred_compiler);
+    if (!chosen_linker.has_value())
+        return std::nullopt;
+    if (!chosen_linker->empty())
+        link_flags.push_back("-fuse-ld=" + *chosen_linker);
+    if (split_dwarf) {
+        // Lets gdb find symbols without opening every .dwo first
+        if (chosen_linker->empty() || *chosen_linker == "bfd")
+            spdlog::debug("[⚒️] {} can't build a gdb index, skipping it",
+                          chosen_linker->empty() ? "The default linker"
+                                                 : *chosen_linker);
+        else
+            link_flags.push_back("-Wl,--gdb-index");
+    }
+
+    auto old_graph = state && state->graph_path == graph_path
+                         ? state->graph
+                         : graph::load(graph_path);
+    graph::BuildGraph new_graph;
+    graph::MtimeCache mtimes;
+    auto save_graph = [&]() {
+        graph::save(new_graph, graph_path);
+        if (state) {
+            state->graph_path = graph_path;
+            state->graph = new_graph;
+        }
+    };
+
+    // Forget (and clean up after) sources that no longer exist
+    for (const auto &[source, unit] : old_graph.units) {
+        bool still_exists = std::any_of(
+            units.begin(), units.end(),
+            [&](const auto &tu) { return tu.source == source; });
+        if (still_exists) {
+            new_graph.units[source] = unit;
+        } else {
+            auto stem =
+                (obj_dir / std::filesystem::path(source).filename()).string();
+            std::filesystem::remove(stem + ".o");
+            std::filesystem::remove(stem + ".d");
+            std::filesystem::remove(stem + ".dwo");
+        }
+    }
+
+    // Shared by all compile jobs, filled in once we know there's work to do
+    std::string cache_prefix;
+    std::unique_ptr<remote::Pool> pool;
+    std::string remote_identity;
+    auto remote_flags = remote::codegen_only(compile_flags);
+    std::atomic<uint64_t> cache_hits = 0;
+    std::atomic<uint64_t> cache_misses = 0;
+
+    auto compile_command = [&](const TranslationUnit &tu) {
+        std::vector<std::string> cmd = {app_config->preferred_compiler};
+        cmd.insert(cmd.end(), compile_flags.begin(), compile_flags.end());
+        cmd.insert(cmd.end(), {"-MMD", "-MF", tu.depfile});
+        // Neither compiler knows .cppm/.ixx on its own, and clang has to be
+        // told where the BMI goes (gcc asks the mapper)
+        auto info = module_info.find(tu.source);
+        if (info != module_info.end() && !info->second.provides.empty()) {
+            if (clang) {
+                cmd.insert(cmd.end(),
+                           {"-x", "c++-module",
+                            "-fmodule-output=" + bmis.at(info->second.provides)});
+            } else if (!tu.source.ends_with(".cpp")) {
+                cmd.insert(cmd.end(), {"-x", "c++"});
+            }
+        }
+        cmd.insert(cmd.end(), {"-c", tu.source, "-o", tu.object});
+        return cmd;
+    };
+
+    // Modules compile in waves: a unit goes one past the deepest unit it
+    // imports from, so every BMI exists before anything reads it
+    std::vector<unsigned> wave(units.size(), 0);
+    std::vector<std::vector<size_t>> providers(units.size());
+    if (uses_modules) {
+        std::map<std::string, size_t> provided_by;
+        for (size_t i = 0; i < units.size(); ++i) {
+            auto info = module_info.find(units[i].source);
+            if (info == module_info.end() || info->second.provides.empty())
+                continue;
+            auto [existing, added] =
+                provided_by.emplace(info->second.provides, i);
+            if (!added) {
+                spdlog::error("[⚒️] ❌ Both {} and {} declare module '{}'",
+                              units[existing->second].source, units[i].source,
+                              info->second.provides);
+                return std::nullopt;
+            }
+        }
+        for (size_t i = 0; i < units.size(); ++i) {
+            auto info = module_info.find(units[i].source);
+            if (info == module_info.end())
+                continue;
+            for (const auto &name : info->second.imports) {
+                if (modules::STD_MODULES.contains(name))
+                    continue;
+                auto provider = provided_by.find(name);
+                if (provider == provided_by.end()) {
+                    spdlog::error("[⚒️] ❌ {} imports '{}', but nothing in src "
+                                  "declares it",
+                                  units[i].source, name);
+                    return std::nullopt;
+                }
+                providers[i].push_back(provider->second);
+            }
+        }
+
+        std::vector<int> state(units.size(), 0); // 1 = visiting, 2 = done
+        std::function<bool(size_t)> visit = [&](size_t i) {
+            if (state[i] == 2)
+                return true;
+            if (state[i] == 1) {
+                spdlog::error("[⚒️] ❌ Modules import each other in a cycle "
+                              "(through {})",
+                              units[i].source);
+                return false;
+            }
+            state[i] = 1;
+            for (auto provider : providers[i]) {
+                if (!visit(provider))
+                    return false;
+                wave[i] = std::max(wave[i], wave[provider] + 1);
+            }
+            state[i] = 2;
+            return true;
+        };
+        for (size_t i = 0; i < units.size(); ++i) {
+            if (!visit(i))
+                return std::nullopt;
+        }
+    }
+
+    // A batch that fails while all of its sources compile on their own is a
+    // unity collision (two anonymous-namespace helpers with the same name, a
+    // leaked macro, ...). Each source gets added to a fresh batch in turn,
+    // and those that break it get isolated for good.
+    std::mutex isolated_mutex;
+    std::vector<bool> split(units.size(), false);
+    std::vector<std::map<std::string, graph::Unit>> split_units(units.size());
+    auto split_batch = [&](size_t i, JobLog &log) {
+        const auto &batch = members[i];
+        log.warn("[⚒️] ⚠️ Unity batch {} failed, compiling its {} sources "
+                 "separately",
+                 units[i].source, batch.size());
+        for (const auto &tu : batch) {
+            auto cmd = compile_command(tu);
+            auto out = process::run(cmd);
+            if (out.exit_code != 0) {
+                log.error("[⚒️] ❌ Failed to compile {}.", tu.source);
+                log.error("[⚒️] ❌ {}", out.output);
+                return false;
+            }
+            split_units[i][tu.source] = graph::Unit{
+                graph::hash_command(cmd), graph::parse_depfile(tu.depfile)};
+        }
+
+        auto probe = units[i].source + ".probe.cpp";
+        std::vector<TranslationUnit> good;
+        std::vector<std::string> culprits;
+        for (const auto &tu : batch) {
+            good.push_back(tu);
+            write_if_changed(
+                probe, unity::batch_source(
+                           good, std::filesystem::path(probe).parent_path()));
+            std::vector<std::string> check_cmd = {
+                app_config->preferred_compiler};
+            check_cmd.insert(check_cmd.end(), compile_flags.begin(),
+                             compile_flags.end());
+            check_cmd.insert(check_cmd.end(), {"-fsyntax-only", probe});
+            if (process::run(check_cmd).exit_code != 0) {
+                good.pop_back();
+                culprits.push_back(tu.source);
+            }
+        }
+        std::filesystem::remove(probe);
+        if (culprits.empty()) {
+            // Only fails past the front end, so there's nothing to narrow
+            // down with -fsyntax-only
+            for (const auto &tu : batch) {
+                culprits.push_back(tu.source);
+            }
+        }
+
+        std::lock_guard lock(isolated_mutex);
+        for (const auto &source : culprits) {
+            log.warn("[⚒️] ⚠️ {} breaks unity builds, compiling it on its own "
+                     "from now on",
+                     source);
+            isolated.insert(source);
+        }
+        split[i] = true;
+        return true;
+    };
+
+    std::vector<std::vector<std::string>> compile_cmds(units.size());
+    std::vector<bool> stale(units.size(), false);
+    for (size_t i = 0; i < units.size(); ++i) {
+        compile_cmds[i] = compile_command(units[i]);
+        auto previous = new_graph.units.find(units[i].source);
+        stale[i] = graph::is_stale(units[i],
+                                   previous == new_graph.units.end()
+                                       ? nullptr
+                                       : &previous->second,
+                                   graph::hash_command(compile_cmds[i]), mtimes);
+    }
+    // Anything importing an interface that's about to change is stale too
+    if (uses_modules) {
+        std::vector<size_t> order(units.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return wave[a] < wave[b]; });
+        for (auto i : order) {
+            for (auto provider : providers[i]) {
+                if (stale[provider])
+                    stale[i] = true;
+            }
+        }
+    }
+
+    // Everything that's out of date becomes one job, indexed like `units`
+    std::vector<Job> jobs;
+    std::vector<unsigned> job_waves;
+    std::vector<std::optional<graph::Unit>> compiled(units.size());
+    for (size_t i = 0; i < units.size(); ++i) {
+        if (!stale[i])
+            continue;
+        const auto &tu = units[i];
+        const auto &compile_cmd = compile_cmds[i];
+        auto command_hash = graph::hash_command(compile_cmd);
+
+        auto compile = [&, i, compile_cmd, command_hash](JobLog &log) {
+            const auto &tu = units[i];
+            trace::Scope span("compile " + tu.source, "compile");
+            // Importers also go stale with the BMIs they read, which the
+            // depfile doesn't mention
+            auto unit_deps = [&]() {
+                auto deps = graph::parse_depfile(tu.depfile);
+                auto info = module_info.find(tu.source);
+                if (info != module_info.end()) {
+                    for (const auto &name : info->second.imports) {
+                        deps.push_back(bmis.at(name));
+                    }
+                }
+                return deps;
+            };
+
+            // Hash the preprocessed source (which also writes the depfile)
+            // and try to skip the real compile entirely. Module units can't:
+            // what they compile to depends on BMIs the key knows nothing of.
+            // Workers get the same preprocessed source, so the same applies.
+            std::optional<std::string> key;
+            std::optional<remote::Request> request;
+            if ((use_cache || pool) && !module_info.contains(tu.source)) {
+                auto preprocessed = tu.object + ".ii";
+                std::vector<std::string> preprocess_cmd = {
+                    app_config->preferred_compiler};
+                preprocess_cmd.insert(preprocess_cmd.end(),
+                                      compile_flags.begin(),
+                                      compile_flags.end());
+                // gcc would write our cwd into it for the debug info, which
+                // both keys it to this checkout and outlives the prefix map
+                if (!prefix_map.empty() &&
+                    !profile::is_clang(app_config->preferred_compiler))
+                    preprocess_cmd.push_back("-fno-working-directory");
+                preprocess_cmd.insert(preprocess_cmd.end(),
+                                      {"-MMD", "-MF", tu.depfile, "-E",
+                                       tu.source, "-o", preprocessed});
+                if (process::run(preprocess_cmd).exit_code == 0) {
+                    auto digest = sha256_file(preprocessed);
+                    if (digest.has_value() && use_cache)
+                        key = Sha256().update(cache_prefix).update(*digest).hex();
+                    // The .dwo would stay behind on the worker
+                    if (pool && !split_dwarf) {
+                        std::ifstream in(preprocessed, std::ios::binary);
+                        request = remote::Request{
+                            app_config->preferred_compiler, remote_identity,
+                            tu.source, remote_flags,
+                            std::string(std::istreambuf_iterator<char>(in),
+                                        std::istreambuf_iterator<char>())};
+                    }
+                }
+                std::filesystem::remove(preprocessed);
+
+                if (key.has_value() && cache::restore(*key, tu.object)) {
+                    log.info("[⚒️] Compiling {} (cached)", tu.source);
+                    compiled[i] = graph::Unit{
+                        command_hash, graph::parse_depfile(tu.depfile)};
+                    ++cache_hits;
+                    return true;
+                }
+            }
+
+            auto compile_locally = [&]() { return process::run(compile_cmd); };
+            ExecResult out;
+            if (pool) {
+                out = pool->compile(tu.source, request, tu.object,
+                                    compile_locally, log);
+            } else {
+                log.info("[⚒️] Compiling {}", tu.source);
+                out = compile_locally();
+            }
+            if (out.exit_code != 0 && members[i].size() > 1)
+                return split_batch(i, log);
+            if (out.exit_code != 0) {
+                log.error("[⚒️] ❌ Failed to compile {}.", tu.source);
+                log.error("[⚒️] ❌ {}", out.output);
+                return false;
+            }
+            if (options.time_report && !clang_trace) {
+                auto table = out.output.find("Time variable");
+                write_if_changed(time_report::trace_path(tu.object, false),
+                                 table == std::string::npos
+                                     ? ""
+                                     : out.output.substr(table));
+                out.output.resize(std::min(table, out.output.size()));
+                while (!out.output.empty() &&
+                       std::isspace((unsigned char)out.output.back()))
+                    out.output.pop_back();
+            }
+            if (!out.output.empty()) {
+                log.warn("[⚒️] {}", out.output); // Compiler warnings
+            }
+            if (key.has_value()) {
+                cache::store(*key, tu.object);
+                ++cache_misses;
+            }
+            compiled[i] = graph::Unit{command_hash, unit_deps()};
+            return true;
+        };
+        jobs.push_back({tu.source, compile});
+        job_waves.push_back(wave[i]);
+    }
+
+    bool compiled_any = !jobs.empty();
+    if (compiled_any && use_cache) {
+        std::vector<std::string> key_flags;
+        std::copy_if(compile_flags.begin(), compile_flags.end(),
+                     std::back_inserter(key_flags),
+                     [&](const std::string &flag) { return flag != prefix_map; });
+        cache_prefix = cache::key_prefix(
+            *app_config, cache::compiler_identity(app_config->preferred_compiler),
+            key_flags, link_flags);
+    }
+    unsigned max_parallel = options.jobs;
+    // Workers only take flags that can't touch their files, see allowed_flag
+    auto refused_flag = std::find_if_not(remote_flags.begin(),
+                                         remote_flags.end(),
+                                         remote::allowed_flag);
+    if (compiled_any && !options.workers.empty() &&
+        refused_flag != remote_flags.end()) {
+        spdlog::warn("[⚒️] ⚠️ Workers don't take '{}', compiling here",
+                     *refused_flag);
+    }
+    // The PGO steps' flags point at profile data only this machine has, and
+    // time reports would be left behind on the workers
+    if (compiled_any && !options.workers.empty() && options.extra_flags.empty() &&
+        !options.time_report && refused_flag == remote_flags.end()) {
+        pool = std::make_unique<remote::Pool>(options.workers, options.jobs);
+        if (pool->empty()) {
+            pool.reset();
+        } else {
+            remote_identity =
+                Sha256()
+                    .update(cache::compiler_identity(app_config->preferred_compiler))
+                    .hex();
+            max_parallel = pool->total_slots();
+        }
+    }
+    // Without modules everything is in wave 0, and this is a single run
+    bool success = true;
+    unsigned last_wave =
+        job_waves.empty() ? 0
+                          : *std::max_element(job_waves.begin(), job_waves.end());
+    for (unsigned w = 0; w <= last_wave; ++w) {
+        if (!success && !options.keep_going)
+            break;
+        std::vector<Job> wave_jobs;
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            if (job_waves[j] == w)
+                wave_jobs.push_back(jobs[j]);
+        }
+        success = run_jobs(wave_jobs, max_parallel, options.keep_going) &&
+                  success;
+    }
+    cache::record_stats({cache_hits, cache_misses});
+    if (std::find(split.begin(), split.end(), true) != split.end())
+        unity::save_isolated(obj_dir, isolated);
+
+    // Failed (or never started) units lose their entry so they rebuild next time
+    for (size_t i = 0; i < units.size(); ++i) {
+        if (!stale[i])
+            continue;
+        // Sources from a split batch are remembered like standalone units:
+        // isolated ones stay built, the rest get cleaned up next time
+        new_graph.units.merge(split_units[i]);
+        if (compiled[i].has_value()) {
+            new_graph.units[units[i].source] = *compiled[i];
+        } else {
+            new_graph.units.erase(units[i].source);
+        }
+    }
+
+    if (!success) {
+        spdlog::error("[⚒️] ❌ Failed to compile.");
+        new_graph.link_hash.clear();
+        save_graph();
+        return std::nullopt;
+    }
+
+    auto output = (output_dir / app_config->name).generic_string();
+    // Split batches link their sources' own objects instead
+    std::vector<std::string> objects;
+    std::vector<std::pair<std::string, std::string>> compiled_units;
+    for (size_t i = 0; i < units.size(); ++i) {
+        if (!split[i]) {
+            objects.push_back(units[i].object);
+            compiled_units.emplace_back(units[i].source, units[i].object);
+            continue;
+        }
+        for (const auto &tu : members[i]) {
+            objects.push_back(tu.object);
+            compiled_units.emplace_back(tu.source, tu.object);
+        }
+    }
+    if (options.time_report &&
+        !time_report::summarize(compiled_units, app_config->preferred_compiler,
+                                clang_trace, output_dir / "time-report.json"))
+        return std::nullopt;
+    objects.insert(objects.end(), module_objects.begin(), module_objects.end());
+    // Archives go straight on the link line, so needs_link sees them change
+    objects.insert(objects.end(), dep_libs->archives.begin(),
+                   dep_libs->archives.end());
+
+    if (state) {
+        state->output_dir = output_dir;
+        state->compile_flags = compile_flags;
+        state->link_flags = link_flags;
+        state->link_inputs.clear();
+        for (size_t i = 0; i < compiled_units.size(); ++i) {
+            if (compiled_units[i].first != MAIN_SOURCE)
+                state->link_inputs.push_back(objects[i]);
+        }
+        state->link_inputs.insert(state->link_inputs.end(),
+                                  objects.begin() + compiled_units.size(),
+                                  objects.end());
+    }
+
+    std::vector<std::string> link_cmd = {app_config->preferred_compiler};
+    link_cmd.insert(link_cmd.end(), objects.begin(), objects.end());
+    link_cmd.insert(link_cmd.end(), {"-o", output});
+    link_cmd.insert(link_cmd.end(), link_flags.begin(), link_flags.end());
+    auto link_hash = graph::hash_command(link_cmd);
+
+    if (!compiled_any && old_graph.link_hash == link_hash &&
+        !graph::needs_link(output, objects)) {
+        spdlog::info("[⚒️] ✅ Up to date!");
+        return output;
+    }
+
+    spdlog::info("[⚒️] Linking: {}", shell_join(link_cmd));
+    trace::Scope link_span("link " + output, "link");
+    auto link_start = std::chrono::steady_clock::now();
+    auto out = process::run(link_cmd, process::Output::Stream);
+    auto link_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - link_start)
+                       .count();
+
+    if (out.exit_code != 0) {
+        spdlog::error("[⚒️] ❌ Failed to link.");
+        new_graph.link_hash.clear();
+        save_graph();
+        return std::nullopt;
+    }
+
+    new_graph.link_hash = link_hash;
+    save_graph();
+    spdlog::info("[⚒️] Linked in {} ms ({})", link_ms,
+                 chosen_linker->empty() ? "default linker" : *chosen_linker);
+    spdlog::info("[⚒️] ✅ Build successful!");
+    return output;
+}
+
+namespace pgo {
+// Instrumented build -> training run -> merged profile -> optimised build of
+// the profile's normal output. Returns the optimised binary.
+std::optional<std::string> run(const BuildOptions &options,
+                               std::string train_cmd) {
+    trace::Scope span("pgo", "build");
+    auto app_config = parse_config_file(
+        "dreamcpp.toml",
+        std::filesystem::current_path().filename().string());
+    if (!app_config.has_value())
+        return std::nullopt;
+    auto profile = profile::resolve(*app_config, options.profile);
+    if (!profile.has_value())
+        return std::nullopt;
+    if (profile->opt_level == "0") {
+        spdlog::error("[⚒️] ❌ Profile '{}' doesn't optimise, so there's "
+                      "nothing for PGO to guide",
+                      profile->name);
+        spdlog::info("[⚒️] 💡 Use an optimised profile, e.g. -p release");
+        return std::nullopt;
+    }
+    bool clang = profile::is_clang(app_config->preferred_compiler);
+    std::filesystem::path output_dir = profile->output_dir;
+    auto pgo_dir = output_dir / "pgo";
+    auto data_dir = std::filesystem::absolute(pgo_dir / "data");
+
+    // Neither kind of object can come out of the compile cache: instrumented
+    // ones have their counter file paths baked in, and the profile data the
+    // optimised ones depend on isn't part of any cache key
+    spdlog::info("[⚒️] PGO 1/4: instrumented build");
+    BuildOptions instrumented = options;
+    instrumented.use_cache = false;
+    instrumented.output_dir = (pgo_dir / "instrumented").string();
+    instrumented.extra_flags.push_back(clang ? "-fprofile-instr-generate"
+                                             : "-fprofile-generate");
+    auto instrumented_binary = build(instrumented);
+    if (!instrumented_binary.has_value())
+        return std::nullopt;
+    const auto &binary = *instrumented_binary;
+
+    // Counters from an older training run would get mixed into this one
+    std::filesystem::remove_all(data_dir);
+    std::filesystem::create_directories(data_dir);
+    // Deps' objects sit under lib/obj, the project's under obj
+    auto instrumented_dir = pgo_dir / "instrumented";
+    for (const auto &entry :
+         std::filesystem::recursive_directory_iterator(instrumented_dir)) {
+        if (entry.path().extension() == ".gcda")
+            std::filesystem::remove(entry.path());
+    }
+
+    if (train_cmd.empty())
+        train_cmd = profile->pgo_train;
+    if (train_cmd.empty())
+        train_cmd = shell_quote(binary);
+    spdlog::info("[⚒️] PGO 2/4: training run: {}", train_cmd);
+    setenv("LLVM_PROFILE_FILE", (data_dir / "%p-%m.profraw").c_str(), 1);
+    setenv("DREAMCPP_PGO_BINARY",
+           std::filesystem::absolute(binary).c_str(), 1);
+    {
+        trace::Scope train_span("pgo training run", "build");
+        auto result =
+            process::run({"sh", "-c", train_cmd}, process::Output::Inherit);
+        if (result.exit_code != 0) {
+            spdlog::error("[⚒️] ❌ Training run failed (exit code {}).",
+                          result.exit_code);
+            return std::nullopt;
+        }
+    }
+
+    spdlog::info("[⚒️] PGO 3/4: merging profiles");
+    std::vector<std::string> use_flags;
+    if (clang) {
+        auto merged = (data_dir / "merged.profdata").string();
+        std::vector<std::string> merge_cmd = {"llvm-profdata", "merge", "-o",
+                                              merged};
+        for (const auto &entry : std::filesystem::directory_iterator(data_dir)) {
+            if (entry.path().extension() == ".profraw")
+                merge_cmd.push_back(entry.path().string());
+        }
+        if (merge_cmd.size() == 4) {
+            spdlog::error("[⚒️] ❌ The training run didn't write any profile "
+                          "data. Did it run {}?",
+                          binary);
+            return std::nullopt;
+        }
+        auto result = process::run(merge_cmd);
+        if (result.exit_code != 0) {
+            spdlog::error("[⚒️] ❌ llvm-profdata failed: {}", result.output);
+            return std::nullopt;
+        }
+        use_flags = {"-fprofile-instr-use=" + merged};
+    } else {
+        // gcc looks for <object>.gcda next to each object it builds, so the
+        // counters just move over to where the optimised objects will go
+        size_t copied = 0;
+        for (const auto &entry :
+             std::filesystem::recursive_directory_iterator(instrumented_dir)) {
+            if (entry.path().extension() != ".gcda")
+                continue;
+            auto target = output_dir / std::filesystem::relative(
+                                           entry.path(), instrumented_dir);
+            std::filesystem::create_directories(target.parent_path());
+            std::filesystem::copy_file(
+                entry.path(), target,
+                std::filesystem::copy_options::overwrite_existing);
+            ++copied;
+        }
+        if (copied == 0) {
+            spdlog::error("[⚒️] ❌ The training run didn't write any profile "
+                          "data. Did it run {}?",
+                          binary);
+            return std::nullopt;
+        }
+        use_flags = {"-fprofile-use", "-fprofile-partial-training",
+                     "-Wno-missing-profile"};
+    }
+
+    spdlog::info("[⚒️] PGO 4/4: optimised build");
+    BuildOptions optimised = options;
+    optimised.use_cache = false;
+    optimised.extra_flags.insert(optimised.extra_flags.end(),
+                                 use_flags.begin(), use_flags.end());
+    // The flags don't change between training runs, but the objects must,
+    // deps' archives included
+    std::filesystem::remove(output_dir / "obj" / graph::GRAPH_FILE);
+    if (std::filesystem::is_directory(output_dir / "lib")) {
+        for (const auto &entry :
+             std::filesystem::directory_iterator(output_dir / "lib")) {
+            if (entry.path().extension() == ".stamp")
+                std::filesystem::remove(entry.path());
+        }
+    }
+    return build(optimised);
+}
+} // namespace pgo
+
+namespace watch {
+struct Options {
+    BuildOptions build;
+    bool run = false; // Restart the binary after every successful build
+};
+
+enum class Change { Sources, Config };
+
+// inotify on src/ (recursively), the config's include dirs and the project
+// root, where only dreamcpp.toml matters
+class Watcher {
+  public:
+    Watcher() : fd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) {}
+    ~Watcher() {
+        if (fd >= 0)
+            close(fd);
+    }
+    Watcher(const Watcher &) = delete;
+    Watcher &operator=(const Watcher &) = delete;
+
+    bool ok() const { return fd >= 0; }
+
+    void add_tree(const std::filesystem::path &dir) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(dir, ec) || watched.contains(dir))
+            return;
+        add(dir);
+        // Things get deleted under us while we walk, that mustn't throw
+        for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (it->is_directory(ec))
+                add(it->path());
+        }
+    }
+
+    void add_root() { root = add("."); }
+
+    // Blocks until something relevant changes. Editors tend to save in a
+    // burst of events (temp file, rename, chmod), so it then waits for
+    // things to go quiet before answering.
+    Change wait() {
+        bool config = false;
+        bool changed = false;
+        int timeout = -1;
+        while (true) {
+            pollfd pfd = {fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready <= 0) {
+                if (changed)
+                    return config ? Change::Config : Change::Sources;
+                continue;
+            }
+            drain(config, changed);
+            if (changed)
+                timeout = 50;
+        }
+    }
+
+  private:
+    int add(const std::filesystem::path &dir) {
+        int wd = inotify_add_watch(fd, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                       IN_MOVED_FROM | IN_MOVED_TO |
+                                       IN_DELETE_SELF);
+        if (wd < 0) {
+            spdlog::warn("[👀] ⚠️ Can't watch '{}': {}", dir.string(),
+                         strerror(errno));
+            return wd;
+        }
+        dirs[wd] = dir;
+        watched.insert(dir);
+        return wd;
+    }
+
+    void drain(bool &config, bool &changed) {
+        alignas(inotify_event) char buffer[16 * 1024];
+        ssize_t len;
+        while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char *at = buffer; at < buffer + len;) {
+                auto *event = reinterpret_cast<inotify_event *>(at);
+                at += sizeof(inotify_event) + event->len;
+                std::string name = event->len ? event->name : "";
+
+                // The dir is gone (or the watch with it), so forget it: if
+                // it comes back its parent's IN_CREATE re-adds it
+                if (event->mask & IN_IGNORED) {
+                    auto dir = dirs.find(event->wd);
+                    if (dir != dirs.end()) {
+                        watched.erase(dir->second);
+                        dirs.erase(dir);
+                    }
+                    if (event->wd == root)
+                        root = -1;
+                    continue;
+                }
+                if (event->mask & IN_DELETE_SELF) {
+                    changed = true;
+                    continue;
+                }
+                if (event->wd == root) {
+                    if (name == "dreamcpp.toml")
+                        config = changed = true;
+                    continue;
+                }
+                // Swap files, backups and the like
+                if (name.empty() || name.starts_with('.') ||
+                    name.ends_with('~') || name == "4913")
+                    continue;
+                auto dir = dirs.find(event->wd);
+                if (dir != dirs.end() && (event->mask & IN_ISDIR) &&
+                    (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                    add_tree(dir->second / name);
+                changed = true;
+            }
+        }
+    }
+
+    int fd;
+    int root = -1;
+    std::map<int, std::filesystem::path> dirs;
+    std::set<std::filesystem::path> watched;
+};
+
+// The binary from the last good build, when `--run` is on
+struct Runner {
+    process::Child child;
+
+    void stop() {
+        if (child.pid < 0)
+            return;
+        kill(child.pid, SIGTERM);
+        process::wait_all({&child}, std::chrono::seconds(2));
+    }
+
+    void start(const std::string &binary) {
+        stop();
+        spdlog::info("[👀] Running: {}", binary);
+        child = process::spawn({binary}, process::Output::Inherit);
+        if (child.pid < 0)
+            spdlog::error("[👀] ❌ {}", child.result.output);
+    }
+};
+
+// Config, build graph and dependency index stay in memory between builds,
+// so an edit costs about as much as recompiling what it touched
+bool run(const Options &options) {
+    Watcher watcher;
+    if (!watcher.ok()) {
+        spdlog::error("[👀] ❌ inotify isn't available: {}", strerror(errno));
+        return false;
+    }
+
+    BuildState state;
+    Runner runner;
+    auto watch_config = [&]() {
+        watcher.add_tree("src");
+        if (state.config.has_value()) {
+            for (const auto &include : state.config->includes) {
+                watcher.add_tree(include);
+            }
+        }
+    };
+    auto rebuild = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        auto binary = build(options.build, &state);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        if (!binary.has_value()) {
+            spdlog::warn("[👀] ⚠️ Build failed after {} ms, waiting for "
+                         "changes...",
+                         ms);
+            return;
+        }
+        spdlog::info("[👀] ✅ Built in {} ms, waiting for changes...", ms);
+        if (options.run)
+            runner.start(*binary);
+    };
+
+    watcher.add_root();
+    rebuild();
+    watch_config();
+    while (true) {
+        auto change = watcher.wait();
+        if (change == Change::Config) {
+            spdlog::info("[👀] dreamcpp.toml changed");
+            auto previous = state.config;
+            auto config = parse_config_file(
+                "dreamcpp.toml",
+                std::filesystem::current_path().filename().string());
+            // A new or removed dep needs a sync before it can build
+            auto dep_names = [](const AppConfig &config) {
+                std::set<std::string> names;
+                for (const auto &dep : config.deps) {
+                    names.insert(dep.name);
+                }
+                return names;
+            };
+            if (config.has_value() &&
+                (!previous.has_value() ||
+                 dep_names(*config) != dep_names(*previous))) {
+                dependency::sync();
+            }
+            state.config = config; // Failing to parse it again reports why
+        }
+        rebuild();
+        watch_config();
+    }
+}
+} // namespace watch
+
+// A workspace is a directory whose dreamcpp.workspace.toml lists member
+// projects, e.g. `members = ["app", "libs/net"]`. Members share one
+// dependency store (the root's build/deps and build/includes, pinned by the
+// root's dreamcpp.lock), so a dep they have in common is only fetched once,
+// and only built once thanks to the lib cache's locks.
+namespace workspace {
+struct Member {
+    std::string path; // As listed, relative to the workspace root
+    AppConfig config;
+};
+
+std::optional<std::vector<Member>> load() {
+    std::vector<Member> members;
+    try {
+        toml::table tbl = toml::parse_file(WORKSPACE_MANIFEST);
+        auto list = tbl["members"].as_array();
+        if (!list) {
+            spdlog::error("[📖] ❌ {} has no members list", WORKSPACE_MANIFEST);
+            return std::nullopt;
+        }
+        for (const auto &val : *list) {
+            auto path = val.value<std::string>();
+            if (!path.has_value())
+                continue;
+            auto config_path = std::filesystem::path(*path) / "dreamcpp.toml";
+            if (!std::filesystem::exists(config_path)) {
+                spdlog::error("[📖] ❌ Workspace member '{}' has no "
+                              "dreamcpp.toml",
+                              *path);
+                return std::nullopt;
+            }
+            auto config = parse_config_file(
+                config_path.string(),
+                std::filesystem::canonical(*path).filename().string());
+            if (!config.has_value())
+                return std::nullopt;
+            members.push_back({*path, std::move(*config)});
+        }
+    } catch (const toml::parse_error &err) {
+        spdlog::error("[📖] ❌ Couldn't parse '{}'.", WORKSPACE_MANIFEST);
+        spdlog::error("[📖] ❌ TOML Parse Error: {}", err.description());
+        return std::nullopt;
+    }
+    if (members.empty()) {
+        spdlog::error("[📖] ❌ {} doesn't list any members", WORKSPACE_MANIFEST);
+        return std::nullopt;
     }
+    return members;
+}
 
-    return std::nullopt;
+// Points a member's build/deps and build/includes at the workspace's, so
+// every member sees the same checkouts
+bool link_store(const Member &member) {
+    for (const char *dir : {"deps", "includes"}) {
+        auto store = std::filesystem::path("build") / dir;
+        auto link = std::filesystem::path(member.path) / "build" / dir;
+        std::error_code ec;
+        if (std::filesystem::equivalent(store, link, ec))
+            continue; // Already linked, or the member is the root itself
+        std::filesystem::create_directories(link.parent_path());
+        if (std::filesystem::is_symlink(link, ec)) {
+            std::filesystem::remove(link, ec);
+        } else if (std::filesystem::exists(link, ec)) {
+            // Left over from syncing the member on its own, but it may have
+            // local edits in it, so it's moved aside rather than deleted
+            auto aside = link;
+            aside += ".standalone";
+            if (std::filesystem::exists(aside, ec)) {
+                spdlog::error("[🚀] ❌ {} isn't the workspace's and {} is "
+                              "already taken",
+                              link.generic_string(), aside.generic_string());
+                spdlog::info("[🚀] 💡 Remove whichever you don't need");
+                return false;
+            }
+            std::filesystem::rename(link, aside, ec);
+            if (ec) {
+                spdlog::error("[🚀] ❌ Couldn't move {} aside: {}",
+                              link.generic_string(), ec.message());
+                return false;
+            }
+            spdlog::warn("[🚀] ⚠️ Moved {} to {} to use the workspace's",
+                         link.generic_string(), aside.generic_string());
+        }
+        std::filesystem::create_directory_symlink(
+            std::filesystem::relative(store, link.parent_path()), link, ec);
+        if (ec) {
+            spdlog::error("[🚀] ❌ Couldn't link {} to the workspace's: {}",
+                          link.generic_string(), ec.message());
+            return false;
+        }
+    }
+    return true;
 }
 
-std::optional<DepIndex> resolve_dependency_url(const std::string &dep_name) {
-    // Try local indexes first
-    // if (auto local_result = search_local_indexes(dep_name)) {
-    //     return local_result;
-    // }
+// Fetches every member's deps into the shared store in one go
+bool sync(const std::vector<Member> &members,
+          const dependency::SyncOptions &options) {
+    trace::Scope span("sync workspace", "sync");
+    if (process::run({"git", "--version"}).exit_code != 0) {
+        spdlog::error("[🚀] ❌ You don't have git installed. :P");
+        return false;
+    }
 
-    // Fall back to remote index
-    if (auto remote_result = search_remote_index(dep_name)) {
-        return remote_result;
+    // Members share one checkout per dep, so they have to agree on it
+    std::map<std::string, std::pair<std::string, std::string>> wanted;
+    std::vector<std::string> dep_names;
+    for (const auto &member : members) {
+        for (const auto &dep : member.config.deps) {
+            if (dep.system)
+                continue;
+            auto [existing, added] =
+                wanted.emplace(dep.name, std::pair{dep.version, member.path});
+            if (added) {
+                dep_names.push_back(dep.name);
+            } else if (existing->second.first != dep.version) {
+                spdlog::error("[🚀] ❌ '{}' wants {} {}, but '{}' wants {}",
+                              existing->second.second, dep.name,
+                              existing->second.first, member.path, dep.version);
+                return false;
+            }
+        }
     }
+    spdlog::info("[🚀] Syncing {} dependencies for {} members...",
+                 dep_names.size(), members.size());
 
-    return std::nullopt;
+    std::filesystem::create_directories("build/deps");
+    std::filesystem::create_directories("build/includes");
+    if (!dep_names.empty() && !dependency::sync_deps(dep_names, options))
+        return false;
+    return std::all_of(members.begin(), members.end(), link_store);
 }
 
-bool save_config(const AppConfig &config,
-                 const std::string &config_path = "dreamcpp.toml") {
-    // Actually implement this using the existing functions
-    auto serialized = serialise_config(config);
-    return sync_config(serialized, config_path);
+bool sync(const dependency::SyncOptions &options = {}) {
+    auto members = load();
+    return members.has_value() && sync(*members, options);
 }
 
-bool add(const std::string &dep_name) {
-    spdlog::info("[🚀] Adding dependency: {}", dep_name);
-
-    if (!validate_project_environment()) {
+// Syncs, then builds every member at once. Each member builds in its own
+// dreamcpp process (everything in build() is relative to the project), but
+// they all draw compile slots from one jobserver, so together they keep
+// `options.jobs` cores busy rather than taking turns or oversubscribing.
+bool build(const BuildOptions &options) {
+    trace::Scope span("build workspace", "build");
+    auto members = load();
+    if (!members.has_value())
         return false;
-    }
-
-    // Parse current config
-    auto app = parse_config_file(
-        "dreamcpp.toml", std::filesystem::current_path().filename().string());
-    if (!app.has_value()) {
+    spdlog::info("[⚒️] Building {} workspace members ({})...", members->size(),
+                 options.profile);
+    if (!sync(*members, {}))
+        return false;
+    if (!jobserver::active() && !jobserver::create(options.jobs))
         return false;
-    }
 
-    // Check if dependency already exists
-    for (const auto &dep : app->deps) {
-        if (dep.name == dep_name) {
-            spdlog::warn("[🚀] ⚠️  Dependency '{}' already exists", dep_name);
+    std::vector<std::string> argv = {
+        std::filesystem::read_symlink("/proc/self/exe").string(),
+        "build",
+        "-p",
+        options.profile,
+        "-j",
+        std::to_string(options.jobs)};
+    if (options.keep_going)
+        argv.push_back("--keep-going");
+    if (!options.use_cache)
+        argv.push_back("--no-cache");
+    if (!options.use_pch)
+        argv.push_back("--no-pch");
+    if (options.unity.has_value())
+        argv.insert(argv.end(), {"--unity", std::to_string(*options.unity)});
+    if (!options.workers.empty())
+        argv.insert(argv.end(), {"--workers", join(options.workers, ",")});
+    if (options.time_report)
+        argv.push_back("--time-report");
+
+    std::vector<Job> jobs;
+    for (const auto &member : *members) {
+        auto build_member = [&, path = member.path](JobLog &log) {
+            trace::Scope span("build " + path, "build");
+            auto out = process::run(argv, process::Output::Capture, path);
+            while (out.output.ends_with('\n'))
+                out.output.pop_back();
+            // One block per member, their logs would interleave otherwise
+            if (out.exit_code != 0) {
+                log.error("[⚒️] ❌ Failed to build {}:\n{}", path, out.output);
+                return false;
+            }
+            log.info("[⚒️] ✅ Built {}:\n{}", path, out.output);
             return true;
-        }
+        };
+        jobs.push_back({member.path, build_member});
     }
-
-    // Resolve the dependency URL to make sure it exists
-    auto repo_url = resolve_dependency_url(dep_name);
-    if (!repo_url.has_value()) {
-        spdlog::error("[🚀] ❌ Dependency not found: {}", dep_name);
-        spdlog::info(
-            "[🚀] ❌ Checked: [~/.dreamcpp/index, ../index, github repo]");
+    if (!run_jobs(jobs, jobs.size(), options.keep_going)) {
+        spdlog::error("[⚒️] ❌ Failed to build the workspace.");
         return false;
     }
+    spdlog::info("[⚒️] ✅ Built all {} members!", members->size());
+    return true;
+}
+} // namespace workspace
 
-    // Add to deps list (don't store the git URL)
-    Dependency new_dep;
-    new_dep.name = dep_name;
-    new_dep.version = "latest"; // Default version
-    // Don't set git field - it will be resolved dynamically
+// `dreamcpp test`: every tests/*.cpp becomes its own binary, linked against
+// the project's objects (all but main()) and deps. Exiting 0 is a pass.
+namespace tests {
+const std::filesystem::path TESTS_DIR = "tests";
+const std::string FAILED_FILE = "failed"; // In <output_dir>/tests
 
-    app->deps.push_back(new_dep);
+struct Options {
+    BuildOptions build;
+    std::vector<std::string> filters; // Run tests whose name has one of these
+    unsigned timeout = 60;            // Seconds, per test
+    std::string shard;                // "i/n", counting from 1
+    bool failed = false;              // Only what failed last time
+};
 
-    // Save updated config
-    if (!save_config(app.value())) {
-        return false;
+enum class Status { Passed, Failed, TimedOut, BuildFailed };
+
+struct Result {
+    std::string name;
+    Status status = Status::BuildFailed;
+    double duration_ms = 0;
+    std::string message; // Why it failed
+    std::string output;
+};
+
+const char *status_name(Status status) {
+    switch (status) {
+    case Status::Passed:
+        return "passed";
+    case Status::Failed:
+        return "failed";
+    case Status::TimedOut:
+        return "timeout";
+    case Status::BuildFailed:
+        return "build-failed";
     }
+    return "";
+}
 
-    spdlog::info("[🚀] ✅ Added dependency '{}' to project", dep_name);
-    spdlog::info("[🚀] 💡 Run 'dreamcpp sync' to install dependencies");
-    return true;
+std::optional<std::pair<unsigned, unsigned>>
+parse_shard(std::string_view text) {
+    auto number = [](std::string_view part) -> std::optional<unsigned> {
+        unsigned value = 0;
+        auto [end, ec] =
+            std::from_chars(part.data(), part.data() + part.size(), value);
+        if (ec != std::errc() || end != part.data() + part.size())
+            return std::nullopt;
+        return value;
+    };
+    auto slash = text.find('/');
+    if (slash == std::string_view::npos)
+        return std::nullopt;
+    auto index = number(text.substr(0, slash));
+    auto count = number(text.substr(slash + 1));
+    if (!index || !count || *index == 0 || *index > *count)
+        return std::nullopt;
+    return std::pair(*index, *count);
 }
 
-bool clone_single_dependency(const std::string &dep_name) {
-    std::string dep_path = std::format("build/deps/{}", dep_name);
+std::set<std::string> load_failed(const std::filesystem::path &fp) {
+    std::set<std::string> failed;
+    std::ifstream file(fp);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty())
+            failed.insert(line);
+    }
+    return failed;
+}
 
-    // Skip if already exists
-    if (std::filesystem::exists(dep_path)) {
-        spdlog::info("[🚀] ⏭️  Skipping '{}' (already exists)", dep_name);
-        return true;
+// Tests that ran leave the list or go (back) on it, the rest keep their entry
+void save_failed(const std::filesystem::path &fp, std::set<std::string> failed,
+                 const std::vector<Result> &results) {
+    for (const auto &result : results) {
+        if (result.status == Status::Passed) {
+            failed.erase(result.name);
+        } else {
+            failed.insert(result.name);
+        }
+    }
+    std::ofstream file(fp);
+    for (const auto &name : failed) {
+        file << name << '\n';
     }
+}
 
-    // Resolve the dependency URL dynamically
-    auto repo_index = resolve_dependency_url(dep_name);
-    if (!repo_index.has_value()) {
-        spdlog::warn("[🚀] ⚠️ Failed to resolve dependency: {}", dep_name);
-        return false;
+std::string xml_escape(std::string_view str) {
+    std::string out;
+    for (unsigned char c : str) {
+        switch (c) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        case '\'':
+            out += "&apos;";
+            break;
+        default:
+            // XML 1.0 has no way to spell the other control characters
+            if (c >= 0x20 || c == '\n' || c == '\t' || c == '\r')
+                out += (char)c;
+        }
     }
+    return out;
+}
 
-    spdlog::info("[🚀] 📦 Cloning '{}'...", dep_name);
-    std::string clone_cmd =
-        std::format("git clone {} {} 2>&1", repo_index->git, dep_path);
+std::string to_junit(const std::string &project,
+                     const std::vector<Result> &results, double total_ms) {
+    auto failures = std::count_if(results.begin(), results.end(), [](auto &r) {
+        return r.status == Status::Failed || r.status == Status::TimedOut;
+    });
+    auto errors = std::count_if(results.begin(), results.end(), [](auto &r) {
+        return r.status == Status::BuildFailed;
+    });
+    auto header = std::format("tests=\"{}\" failures=\"{}\" errors=\"{}\" "
+                              "time=\"{:.3f}\"",
+                              results.size(), failures, errors,
+                              total_ms / 1000);
+    std::string out = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out += std::format("<testsuites {}>\n", header);
+    out += std::format("  <testsuite name=\"{}\" {} skipped=\"0\">\n",
+                       xml_escape(project), header);
+    for (const auto &result : results) {
+        out += std::format("    <testcase classname=\"{}\" name=\"{}\" "
+                           "time=\"{:.3f}\"",
+                           xml_escape(project), xml_escape(result.name),
+                           result.duration_ms / 1000);
+        if (result.status == Status::Passed) {
+            out += "/>\n";
+            continue;
+        }
+        out += std::format(
+            ">\n      <{0} type=\"{1}\" message=\"{2}\">{3}</{0}>\n"
+            "    </testcase>\n",
+            result.status == Status::BuildFailed ? "error" : "failure",
+            status_name(result.status), xml_escape(result.message),
+            xml_escape(result.output));
+    }
+    out += "  </testsuite>\n</testsuites>\n";
+    return out;
+}
 
-    auto result = exec(clone_cmd);
-    if (result.exit_code != 0) {
-        spdlog::error("[🚀] ❌ Failed to clone dependency: {}", dep_name);
-        spdlog::error("[🚀] ❌ Git output: {}", result.output);
-        return false;
+std::string to_json(const std::string &project, const std::string &shard,
+                    const std::vector<Result> &results, double total_ms) {
+    std::string out = "{\n";
+    out += std::format("  \"project\": \"{}\",\n  \"shard\": {},\n  "
+                       "\"duration_ms\": {:.2f},\n  \"tests\": [",
+                       json_escape(project),
+                       shard.empty() ? "null"
+                                     : std::format("\"{}\"", shard),
+                       total_ms);
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &result = results[i];
+        out += std::format(
+            "{}\n    {{\"name\": \"{}\", \"status\": \"{}\", \"duration_ms\": "
+            "{:.2f}, \"message\": \"{}\", \"output\": \"{}\"}}",
+            i ? "," : "", json_escape(result.name), status_name(result.status),
+            result.duration_ms, json_escape(result.message),
+            json_escape(result.output));
     }
+    out += "\n  ]\n}\n";
+    return out;
+}
 
-    if (repo_index->header_only) {
-        try {
-            std::filesystem::create_directory(std::format("build/includes/{}", dep_name));
-            std::filesystem::rename(
-                std::format("build/deps/{}/include/{}", dep_name, dep_name),
-                std::format("build/includes/{}", dep_name)
-            );
-        } catch (const std::filesystem::filesystem_error& e) {
-            spdlog::warn("[🚀] ⚠️ Couldn't move header-only include for '{}': {}", dep_name, e.what());
+// Compiles and links one test, skipping what hasn't changed since last time.
+// Each test keeps its own graph next to its object, so jobs never share one.
+bool build_test(const TranslationUnit &tu, const std::string &binary,
+                const std::string &compiler, const BuildState &state,
+                JobLog &log) {
+    auto graph_path =
+        std::filesystem::path(tu.depfile).replace_extension(".graph").string();
+    auto old_graph = graph::load(graph_path);
+    graph::BuildGraph new_graph;
+
+    std::vector<std::string> compile_cmd = {compiler};
+    compile_cmd.insert(compile_cmd.end(), state.compile_flags.begin(),
+                       state.compile_flags.end());
+    compile_cmd.insert(compile_cmd.end(), {"-Isrc", "-MMD", "-MF", tu.depfile,
+                                           "-c", tu.source, "-o", tu.object});
+    auto command_hash = graph::hash_command(compile_cmd);
+    auto old_unit = old_graph.units.find(tu.source);
+    graph::MtimeCache mtimes;
+    bool compiled = graph::is_stale(tu,
+                                    old_unit == old_graph.units.end()
+                                        ? nullptr
+                                        : &old_unit->second,
+                                    command_hash, mtimes);
+    if (compiled) {
+        log.info("[🧪] Compiling {}", tu.source);
+        auto out = process::run(compile_cmd);
+        if (out.exit_code != 0) {
+            log.error("[🧪] ❌ Failed to compile {}.", tu.source);
+            log.error("[🧪] ❌ {}", out.output);
+            return false;
         }
+        if (!out.output.empty())
+            log.warn("[🧪] {}", out.output); // Compiler warnings
+        new_graph.units[tu.source] = {command_hash,
+                                      graph::parse_depfile(tu.depfile)};
+    } else {
+        new_graph.units[tu.source] = old_unit->second;
     }
 
-    spdlog::info("[🚀] ✅ Successfully cloned: {}", dep_name);
+    std::vector<std::string> objects = {tu.object};
+    objects.insert(objects.end(), state.link_inputs.begin(),
+                   state.link_inputs.end());
+    std::vector<std::string> link_cmd = {compiler};
+    link_cmd.insert(link_cmd.end(), objects.begin(), objects.end());
+    link_cmd.insert(link_cmd.end(), {"-o", binary});
+    link_cmd.insert(link_cmd.end(), state.link_flags.begin(),
+                    state.link_flags.end());
+    auto link_hash = graph::hash_command(link_cmd);
+    if (!compiled && old_graph.link_hash == link_hash &&
+        !graph::needs_link(binary, objects))
+        return true;
+
+    log.info("[🧪] Linking {}", binary);
+    auto out = process::run(link_cmd);
+    if (out.exit_code != 0) {
+        log.error("[🧪] ❌ Failed to link {}.", binary);
+        log.error("[🧪] ❌ {}", out.output);
+        graph::save(new_graph, graph_path); // Without a link hash
+        return false;
+    }
+    new_graph.link_hash = link_hash;
+    graph::save(new_graph, graph_path);
     return true;
 }
 
-bool sync() {
-    spdlog::info("[🚀] Syncing project dependencies...");
+// Runs one test binary from the project root, killing it after `timeout`
+void run_test(Result &result, const std::string &binary,
+              std::chrono::seconds timeout) {
+    auto start = std::chrono::steady_clock::now();
+    // Its own group, so helpers it forks don't outlive it
+    auto child = process::spawn({binary}, process::Output::Capture, {}, true);
+    process::wait_all({&child}, timeout);
+    result.duration_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    result.output = std::move(child.result.output);
+    while (!result.output.empty() &&
+           std::isspace((unsigned char)result.output.back()))
+        result.output.pop_back();
 
-    if (!validate_project_environment()) {
+    if (child.timed_out) {
+        result.status = Status::TimedOut;
+        result.message = std::format("timed out after {}s", timeout.count());
+    } else if (child.result.exit_code == 0) {
+        result.status = Status::Passed;
+    } else {
+        result.status = Status::Failed;
+        result.message = child.signal
+                             ? std::format("crashed ({})",
+                                           strsignal(child.signal))
+                             : std::format("exited with {}",
+                                           child.result.exit_code);
+    }
+}
+
+bool run(const Options &options) {
+    trace::Scope span("test", "test");
+    std::optional<std::pair<unsigned, unsigned>> shard;
+    if (!options.shard.empty()) {
+        shard = parse_shard(options.shard);
+        if (!shard.has_value()) {
+            spdlog::error("[🧪] ❌ --shard takes i/n with 1 <= i <= n, not "
+                          "'{}'",
+                          options.shard);
+            return false;
+        }
+    }
+    if (!std::filesystem::is_directory(TESTS_DIR)) {
+        spdlog::error("[🧪] ❌ No tests directory found");
+        spdlog::info("[🧪] 💡 Every tests/*.cpp is built into its own test, "
+                     "which passes if it exits with 0");
         return false;
     }
 
-    // Parse current config
-    auto app = parse_config_file(
-        "dreamcpp.toml", std::filesystem::current_path().filename().string());
-    if (!app.has_value()) {
+    BuildState state;
+    if (!build(options.build, &state))
+        return false;
+    auto test_dir = state.output_dir / "tests";
+    auto obj_dir = test_dir / "obj";
+    auto units = collect_translation_units(obj_dir, TESTS_DIR);
+    std::erase_if(units,
+                  [](const auto &tu) { return !tu.source.ends_with(".cpp"); });
+    if (units.empty()) {
+        spdlog::error("[🧪] ❌ No test sources found in {}",
+                      TESTS_DIR.string());
         return false;
     }
 
-    if (app->deps.empty()) {
-        spdlog::info("[🚀] ✅ No dependencies to sync");
+    // Shards split the whole (sorted) list, so a shard's tests don't move
+    // around when it only reruns some of them
+    auto last_failed = load_failed(test_dir / FAILED_FILE);
+    std::set<std::string> existing;
+    std::vector<TranslationUnit> selected;
+    for (size_t i = 0; i < units.size(); ++i) {
+        auto name = std::filesystem::path(units[i].source).stem().string();
+        existing.insert(name);
+        if (shard && i % shard->second != shard->first - 1)
+            continue;
+        if (!options.filters.empty() &&
+            std::none_of(options.filters.begin(), options.filters.end(),
+                         [&](const auto &filter) {
+                             return name.find(filter) != std::string::npos;
+                         }))
+            continue;
+        if (options.failed && !last_failed.contains(name))
+            continue;
+        selected.push_back(units[i]);
+    }
+    std::erase_if(last_failed, [&](const auto &name) {
+        return !existing.contains(name); // Deleted since
+    });
+    if (selected.empty()) {
+        spdlog::info(options.failed ? "[🧪] ✅ Nothing failed last time"
+                                    : "[🧪] ✅ No tests to run here");
         return true;
     }
+    std::filesystem::create_directories(obj_dir);
+    std::filesystem::create_directories(test_dir / "bin");
 
-    // Create deps directory if it doesn't exist
-    std::filesystem::create_directories("build/deps");
-
-    // Create includes directory if it doesn't exist
-    std::filesystem::create_directories("build/includes");
+    std::vector<Result> results(selected.size());
+    std::vector<std::string> binaries;
+    // Not vector<bool>, the jobs write their own entries concurrently
+    std::vector<char> built(selected.size(), false);
+    std::vector<Job> build_jobs;
+    for (size_t i = 0; i < selected.size(); ++i) {
+        results[i].name =
+            std::filesystem::path(selected[i].source).stem().string();
+        binaries.push_back(
+            (test_dir / "bin" / results[i].name).generic_string());
+        build_jobs.push_back(
+            {selected[i].source, [&, i](JobLog &log) {
+                 built[i] = build_test(selected[i], binaries[i],
+                                       state.config->preferred_compiler,
+                                       state, log);
+                 if (!built[i])
+                     results[i].message = "didn't build";
+                 return (bool)built[i];
+             }});
+    }
+    run_jobs(build_jobs, options.build.jobs, true);
 
-    // Sequential cloning (TODO: could be parallelized with std::async)
-    bool all_success = true;
-    for (const auto &dep : app->deps) {
-        if (dep.system) {
-            spdlog::info("[🚀] Skipping '{}', is a system library.", dep.name);
+    spdlog::info("[🧪] Running {} test(s){}...", selected.size(),
+                 shard ? std::format(" (shard {}/{})", shard->first,
+                                     shard->second)
+                       : "");
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Job> test_jobs;
+    for (size_t i = 0; i < selected.size(); ++i) {
+        if (!built[i])
             continue;
+        test_jobs.push_back({results[i].name, [&, i](JobLog &log) {
+                                 auto &result = results[i];
+                                 run_test(result, binaries[i],
+                                          std::chrono::seconds(options.timeout));
+                                 if (result.status == Status::Passed) {
+                                     log.info("[🧪] ✅ {} ({:.0f} ms)",
+                                              result.name, result.duration_ms);
+                                     return true;
+                                 }
+                                 log.error("[🧪] ❌ {} {} ({:.0f} ms)",
+                                           result.name, result.message,
+                                           result.duration_ms);
+                                 if (!result.output.empty())
+                                     log.error("{}", result.output);
+                                 return false;
+                             }});
+    }
+    run_jobs(test_jobs, options.build.jobs, true);
+    auto total_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+    auto project = state.config->name;
+    for (const auto &[file, report] :
+         {std::pair(test_dir / "report.json",
+                    to_json(project, options.shard, results, total_ms)),
+          std::pair(test_dir / "report.xml",
+                    to_junit(project, results, total_ms))}) {
+        std::ofstream out(file);
+        out << report;
+        if (!out.good())
+            spdlog::warn("[🧪] ⚠️ Couldn't write {}", file.string());
+    }
+    save_failed(test_dir / FAILED_FILE, std::move(last_failed), results);
+    spdlog::info("[🧪] Wrote report.json and report.xml (JUnit) to {}",
+                 test_dir.string());
+
+    if (results.size() > 1) {
+        auto slowest = results;
+        std::sort(slowest.begin(), slowest.end(), [](auto &a, auto &b) {
+            return a.duration_ms > b.duration_ms;
+        });
+        std::string list;
+        for (size_t i = 0; i < std::min<size_t>(3, slowest.size()); ++i) {
+            if (slowest[i].status != Status::BuildFailed)
+                list += std::format("{}{} ({:.0f} ms)", list.empty() ? "" : ", ",
+                                    slowest[i].name, slowest[i].duration_ms);
         }
-        if (!clone_single_dependency(dep.name)) {
-            all_success = false;
-        }
+        if (!list.empty())
+            spdlog::info("[🧪] Slowest: {}", list);
     }
 
-    if (all_success) {
-        spdlog::info("[🚀] ✅ All dependencies synced successfully");
-    } else {
-        spdlog::warn("[🚀] ⚠️ Some dependencies failed to sync");
+    std::vector<std::string> failed;
+    for (const auto &result : results) {
+        if (result.status != Status::Passed)
+            failed.push_back(result.name);
+    }
+    if (failed.empty()) {
+        spdlog::info("[🧪] ✅ {} test(s) passed in {:.0f} ms", results.size(),
+                     total_ms);
+        return true;
     }
+    std::string names;
+    for (const auto &name : failed) {
+        names += (names.empty() ? "" : ", ") + name;
+    }
+    spdlog::error("[🧪] ❌ {} of {} test(s) failed: {}", failed.size(),
+                  results.size(), names);
+    spdlog::info("[🧪] 💡 Rerun just those with `dreamcpp test --failed`");
+    return false;
+}
+} // namespace tests
 
-    return all_success;
+namespace bench {
+// Sizes of the synthetic project `dreamcpp bench` generates
+struct Options {
+    unsigned sources = 50;
+    unsigned headers = 20;
+    unsigned deps = 3;
+    unsigned repeat = 3;
+    std::string compiler = AppConfig{}.preferred_compiler;
+    std::string linker;                // Left to the project's default if empty
+    std::string dir;                   // Work dir, defaults to a temp dir
+    std::string output = "bench.json"; // Where the JSON results go
+    bool keep = false;                 // Leave the work dir behind
+};
+
+struct Scenario {
+    std::string name;
+    std::vector<double> runs_ms;
+};
+
+bool write_file(const std::filesystem::path &fp, const std::string &data) {
+    std::filesystem::create_directories(fp.parent_path());
+    std::ofstream file(fp, std::ios::binary);
+    file << data;
+    return file.good();
 }
-} // namespace dependency
 
-void build() {
-    spdlog::info("[⚒️] Building this project...");
-    if (!std::filesystem::exists("dreamcpp.toml")) {
-        spdlog::error("[⚒️] ❌ This... isn't a 🌌++ project.");
-        exit(1);
+std::string dep_name(unsigned i) { return std::format("benchdep{}", i); }
+
+// A header-only dep with enough templates in it to cost something to parse
+std::string dep_header(unsigned i) {
+    auto name = dep_name(i);
+    std::string out = std::format("#pragma once\n#include <map>\n#include "
+                                  "<string>\n#include <vector>\n\nnamespace "
+                                  "{} {{\n",
+                                  name);
+    for (unsigned k = 0; k < 20; k++) {
+        out += std::format(
+            "template <typename T> struct Box{} {{\n"
+            "    std::vector<T> items;\n"
+            "    std::map<std::string, T> named;\n"
+            "    T sum() const {{ T s{{}}; for (const auto &x : items) s += x; "
+            "return s; }}\n"
+            "}};\n",
+            k);
     }
-    auto app_config = parse_config_file(
-        "dreamcpp.toml",
-        std::filesystem::current_path().filename().string());
-    if (!app_config.has_value())
-        exit(1);
+    out += std::format("inline int value() {{ Box0<int> b{{{{{}}}}}; return "
+                       "b.sum(); }}\n}} // namespace {}\n",
+                       i, name);
+    return out;
+}
 
-    // Check if src directory exists and has files
-    if (!std::filesystem::exists("src")) {
-        spdlog::error("[⚒️] ❌ No src directory found");
-        exit(1);
+std::string project_header(unsigned i) {
+    return std::format("#pragma once\n#include <string>\n\ninline int "
+                       "header_{}(const std::string &s) {{ return "
+                       "static_cast<int>(s.size()) + {}; }}\n",
+                       i, i);
+}
+
+// Every source pulls in every dep and a handful of project headers, so a
+// header edit or dep change fans out the way it would in a real project
+std::string project_source(unsigned i, const Options &options) {
+    std::string out;
+    for (unsigned d = 0; d < options.deps; d++)
+        out += std::format("#include <{0}/{0}.hpp>\n", dep_name(d));
+    for (unsigned h = 0; h < std::min(options.headers, 4u); h++)
+        out += std::format("#include \"header_{}.hpp\"\n",
+                           (i + h) % options.headers);
+    out += std::format("\nint source_{}() {{\n    int total = 0;\n", i);
+    for (unsigned d = 0; d < options.deps; d++)
+        out += std::format("    total += {}::value();\n", dep_name(d));
+    for (unsigned h = 0; h < std::min(options.headers, 4u); h++)
+        out += std::format("    total += header_{}(\"{}\");\n",
+                           (i + h) % options.headers, i);
+    out += "    return total;\n}\n";
+    return out;
+}
+
+std::string project_main(const Options &options) {
+    std::string out = "#include <cstdio>\n\n";
+    for (unsigned i = 0; i < options.sources; i++)
+        out += std::format("int source_{}();\n", i);
+    out += "\nint main() {\n    long total = 0;\n";
+    for (unsigned i = 0; i < options.sources; i++)
+        out += std::format("    total += source_{}();\n", i);
+    out += "    std::printf(\"%ld\\n\", total);\n    return 0;\n}\n";
+    return out;
+}
+
+// Creates the dep repos and an index pointing at them with file:// remotes
+bool generate_deps(const std::filesystem::path &work, const Options &options) {
+    toml::table index; // Built up rather than formatted, --dir can be anything
+    for (unsigned i = 0; i < options.deps; i++) {
+        auto name = dep_name(i);
+        auto repo = work / "remotes" / name;
+        if (!write_file(repo / "include" / name / (name + ".hpp"),
+                        dep_header(i)))
+            return false;
+        auto git = [&](std::vector<std::string> args) {
+            std::vector<std::string> cmd = {
+                "git", "-C", repo.string(), "-c", "user.name=dreamcpp",
+                "-c", "user.email=bench@dreamcpp.invalid"};
+            cmd.insert(cmd.end(), args.begin(), args.end());
+            auto result = process::run(cmd);
+            if (result.exit_code != 0)
+                spdlog::error("[⏱️] ❌ git failed: {}", result.output);
+            return result.exit_code == 0;
+        };
+        if (!git({"init", "-q"}) || !git({"add", "."}) ||
+            !git({"commit", "-q", "-m", "bench"}))
+            return false;
+        toml::table entry;
+        entry.insert("git", "file://" + repo.string());
+        entry.insert("header", true);
+        index.insert(name, entry);
     }
+    std::ostringstream out;
+    out << index;
+    return write_file(work / "home" / ".dreamcpp" / "index" / "bench.toml",
+                      out.str());
+}
 
-    // construct build commands
-    std::string include_flags = join(app_config->includes, " -I");
-    if (!include_flags.empty()) {
-        include_flags = " -I" + include_flags;
+bool generate_project(const std::filesystem::path &project,
+                      const Options &options) {
+    auto config = parse_config_file((project / "dreamcpp.toml").string(),
+                                    project.filename().string());
+    if (!config.has_value())
+        return false;
+    config->preferred_compiler = options.compiler;
+    if (!options.linker.empty())
+        config->linker = options.linker;
+    for (unsigned i = 0; i < options.deps; i++)
+        config->deps.push_back(Dependency{dep_name(i), "latest"});
+    if (!sync_config(serialise_config(*config),
+                     (project / "dreamcpp.toml").string()))
+        return false;
+
+    auto src = project / "src";
+    std::filesystem::remove_all(src);
+    bool ok = write_file(src / "main.cpp", project_main(options));
+    for (unsigned i = 0; i < options.headers; i++)
+        ok = ok && write_file(src / std::format("header_{}.hpp", i),
+                              project_header(i));
+    for (unsigned i = 0; i < options.sources; i++)
+        ok = ok && write_file(src / std::format("source_{}.cpp", i),
+                              project_source(i, options));
+    return ok;
+}
+
+// Runs this binary again in `cwd` and returns the wall time in ms
+std::optional<double> time_command(const std::filesystem::path &cwd,
+                                   const std::vector<std::string> &args) {
+    auto self = std::filesystem::read_symlink("/proc/self/exe").string();
+    std::vector<std::string> argv = {self};
+    argv.insert(argv.end(), args.begin(), args.end());
+
+    auto previous = std::filesystem::current_path();
+    std::filesystem::current_path(cwd);
+    auto start = std::chrono::steady_clock::now();
+    auto result = process::run(argv);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::filesystem::current_path(previous);
+
+    if (result.exit_code != 0) {
+        spdlog::error("[⏱️] ❌ '{}' failed:\n{}", shell_join(args),
+                      result.output);
+        return std::nullopt;
+    }
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    auto mid = values.size() / 2;
+    return values.size() % 2 ? values[mid]
+                             : (values[mid - 1] + values[mid]) / 2;
+}
+
+std::string to_json(const Options &options,
+                    const std::vector<Scenario> &scenarios) {
+    std::string out = "{\n";
+    out += std::format("  \"project\": {{\"sources\": {}, \"headers\": {}, "
+                       "\"deps\": {}, \"compiler\": \"{}\", \"linker\": "
+                       "\"{}\", \"repeat\": {}}},\n",
+                       options.sources, options.headers, options.deps,
+                       json_escape(options.compiler),
+                       json_escape(options.linker.empty() ? "auto"
+                                                          : options.linker),
+                       options.repeat);
+    out += "  \"scenarios\": [";
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        const auto &scenario = scenarios[i];
+        std::string runs;
+        for (size_t r = 0; r < scenario.runs_ms.size(); r++)
+            runs += std::format("{}{:.2f}", r ? ", " : "", scenario.runs_ms[r]);
+        out += std::format(
+            "{}\n    {{\"name\": \"{}\", \"runs_ms\": [{}], \"min_ms\": "
+            "{:.2f}, \"median_ms\": {:.2f}}}",
+            i ? "," : "", json_escape(scenario.name), runs,
+            *std::min_element(scenario.runs_ms.begin(), scenario.runs_ms.end()),
+            median(scenario.runs_ms));
     }
+    out += "\n  ]\n}\n";
+    return out;
+}
 
-    std::vector<std::string> link_syslibs;
-    for (const auto &dep : app_config->deps) {
-        // spdlog::info("Name: {}", dep.name);
-        if (dep.system) {
-            link_syslibs.push_back(dep.name);
-        }
+bool run(const Options &options) {
+    auto work = options.dir.empty()
+                    ? std::filesystem::temp_directory_path() /
+                          std::format("dreamcpp-bench-{}", getpid())
+                    : std::filesystem::absolute(options.dir);
+    if (std::filesystem::exists(work)) {
+        spdlog::error("[⏱️] ❌ '{}' already exists", work.string());
+        return false;
     }
+    auto output = std::filesystem::absolute(options.output);
+    spdlog::info("[⏱️] Generating {} sources, {} headers and {} deps in {}",
+                 options.sources, options.headers, options.deps,
+                 work.string());
+    // However the run ends, the work dir goes unless it was asked for
+    struct Cleanup {
+        const std::filesystem::path &work;
+        bool keep;
+        ~Cleanup() {
+            if (keep) {
+                spdlog::info("[⏱️] Kept the work dir at {}", work.string());
+                return;
+            }
+            std::error_code ec;
+            std::filesystem::remove_all(work, ec);
+        }
+    } cleanup{work, options.keep};
+
+    // Children get their own ~/.dreamcpp, so the bench neither reads the
+    // user's caches nor leaves anything in them, and deps resolve through
+    // the generated local index without touching the network
+    setenv("HOME", (work / "home").c_str(), 1);
+    setenv("DREAMCPP_INDEX_URL", "http://127.0.0.1:9/offline", 1);
+    std::filesystem::create_directories(work / "home");
+    if (!generate_deps(work, options))
+        return false;
 
-    std::string link_flags = join(link_syslibs, " -l");
-    // if (!link_flags.empty()) {
-    //     link_flags = " -l" + link_flags;
-    // }
+    std::vector<Scenario> scenarios;
+    auto project = work / "bench";
+    // Each scenario runs `prepare` (untimed) and then the command, repeatedly
+    auto measure = [&](const std::string &name,
+                       const std::filesystem::path &cwd,
+                       const std::vector<std::string> &args,
+                       const std::function<void(unsigned)> &prepare) {
+        Scenario scenario{name, {}};
+        for (unsigned r = 0; r < options.repeat; r++) {
+            if (prepare)
+                prepare(r);
+            auto ms = time_command(cwd, args);
+            if (!ms)
+                return false;
+            scenario.runs_ms.push_back(*ms);
+        }
+        spdlog::info("[⏱️] {:<22} median {:>9.2f} ms", name,
+                     median(scenario.runs_ms));
+        scenarios.push_back(std::move(scenario));
+        return true;
+    };
+    auto remove = [&](std::initializer_list<std::filesystem::path> paths) {
+        for (const auto &path : paths)
+            std::filesystem::remove_all(path);
+    };
 
-    auto build_cmd = std::format(
-        "{} src/*.cpp -o build/{} -std={} -Ibuild/includes -Lbuild/lib{}{}",
-        app_config->preferred_compiler, app_config->name,
-        app_config->standard, include_flags, link_flags);
+    // `new` fails on an existing dir, so earlier repeats get moved aside and
+    // the last one becomes the project
+    if (!measure("new", work, {"new", "bench"}, [&](unsigned r) {
+            if (r > 0)
+                std::filesystem::rename(project,
+                                        work / std::format("bench-{}", r));
+        }))
+        return false;
+    for (unsigned r = 1; r < options.repeat; r++)
+        std::filesystem::remove_all(work / std::format("bench-{}", r));
+    if (!generate_project(project, options)) {
+        spdlog::error("[⏱️] ❌ Couldn't write the synthetic project");
+        return false;
+    }
 
-    spdlog::info("[⚒️] Running: {}", build_cmd);
-    auto out = exec(build_cmd);
+    auto home_cache = work / "home" / ".dreamcpp" / "cache";
+    auto touched = project / "src" / "source_0.cpp";
+    bool ok =
+        measure("sync_cold", project, {"sync"},
+                [&](unsigned) {
+                    remove({project / "build" / "deps",
+                            project / "build" / "includes",
+                            project / "dreamcpp.lock", home_cache / "index"});
+                    std::filesystem::create_directories(project / "build" /
+                                                        "includes");
+                }) &&
+        measure("sync_warm", project, {"sync"}, nullptr) &&
+        measure("build_clean", project, {"build"},
+                [&](unsigned) {
+                    remove({project / "build" / "obj", project / "build" / "pch",
+                            home_cache / "obj"});
+                }) &&
+        measure("build_clean_cached", project, {"build"},
+                [&](unsigned) {
+                    remove({project / "build" / "obj",
+                            project / "build" / "pch"});
+                }) &&
+        measure("build_noop", project, {"build"}, nullptr) &&
+        // Every object is up to date, so this is just the link
+        measure("build_link_only", project, {"build"},
+                [&](unsigned) { remove({project / "build" / "bench"}); }) &&
+        // A new function rather than a comment, which the preprocessor (and
+        // so the compile cache) would see straight through
+        measure("build_one_file", project, {"build"},
+                [&](unsigned r) {
+                    std::ofstream file(touched, std::ios::app);
+                    file << std::format("int bench_touch_{}_{}() {{ return "
+                                        "{}; }}\n",
+                                        r, trace::now_us(), r);
+                }) &&
+        measure("run", project, {"run"}, nullptr);
 
-    if (out.exit_code != 0) {
-        spdlog::error("[⚒️] ❌ Failed to compile.");
-        spdlog::error("[⚒️] ❌ {}", out.output);
-        exit(1);
-    } else {
-        spdlog::info("[⚒️] ✅ Build successful!");
+    if (ok) {
+        ok = write_file(output, to_json(options, scenarios));
+        if (ok)
+            spdlog::info("[⏱️] ✅ Results written to {}", output.string());
     }
+    return ok;
 }
+} // namespace bench
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
     spdlog::error("Windows isn't supported (for now).");
     exit(1);
 #endif
+    // curl_easy_init() would do this lazily, but that isn't thread-safe
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
     CLI::App app{"✨ DreamCPP"};
 
     auto verbose = false;
     app.add_flag("-v,--verbose", verbose, "Enable verbose output");
 
+    static std::string trace_path;
+    app.add_option("--trace", trace_path,
+                   "Write a Chrome trace (chrome://tracing, Perfetto) of this "
+                   "run to a JSON file");
+
     std::string config_file_path = "dreamcpp.toml";
     app.add_option("-c,--config", config_file_path,
                    "Path to configuration file")
@@ -553,7 +7731,69 @@ int main(int argc, char **argv) {
         ->required();
 
     auto build_cmd = app.add_subcommand("build", "Builds a 💭++ project");
+    BuildOptions build_options;
+    build_cmd->add_option("-j,--jobs", build_options.jobs,
+                          "Number of compile jobs to run at once")
+        ->check(CLI::PositiveNumber);
+    build_cmd->add_flag("--keep-going", build_options.keep_going,
+                        "Keep compiling other files after a failure");
+    bool no_cache = false;
+    build_cmd->add_flag("--no-cache", no_cache,
+                        "Don't use the shared compile cache");
+    bool no_pch = false;
+    build_cmd->add_flag("--no-pch", no_pch,
+                        "Don't precompile headers from header-only deps");
+    auto profile_opt = build_cmd->add_option(
+        "-p,--profile", build_options.profile,
+        "Build profile: debug, release, release-lto or one from [profiles] "
+        "(release with --pgo)");
+    unsigned unity_size = 0;
+    auto unity_opt = build_cmd->add_option(
+        "--unity", unity_size,
+        "Compile sources in unity batches of this many files (0 turns it "
+        "off, overriding the profile)");
+    bool pgo = false;
+    auto pgo_opt = build_cmd->add_flag(
+        "--pgo", pgo, "Profile-guided build: instrument, train, rebuild");
+    std::string pgo_train;
+    build_cmd->add_option("--pgo-train", pgo_train,
+                          "Shell command for the training run (the "
+                          "instrumented binary is in $DREAMCPP_PGO_BINARY)");
+
+    std::string workers;
+    auto workers_opt = build_cmd->add_option(
+        "--workers", workers,
+        "Comma-separated `dreamcpp worker` endpoints to compile on (default: "
+        "$DREAMCPP_WORKERS)");
+    build_cmd
+        ->add_flag("--time-report", build_options.time_report,
+                   "Report which headers, templates and functions take the "
+                   "longest to compile")
+        ->excludes(pgo_opt);
+
     auto run_cmd = app.add_subcommand("run", "Runs a 💤++ project");
+    BuildOptions run_options;
+    run_cmd->add_option("-p,--profile", run_options.profile,
+                        "Build profile to build and run");
+
+    auto test_cmd = app.add_subcommand(
+        "test", "Builds and runs a 🌠++ project's tests (tests/*.cpp)");
+    tests::Options test_options;
+    test_cmd->add_option("filters", test_options.filters,
+                         "Only run tests whose name contains one of these");
+    test_cmd->add_option("-j,--jobs", test_options.build.jobs,
+                         "Number of compile jobs and tests to run at once")
+        ->check(CLI::PositiveNumber);
+    test_cmd->add_option("-p,--profile", test_options.build.profile,
+                         "Build profile to build the tests with");
+    test_cmd->add_option("--timeout", test_options.timeout,
+                         "Seconds a test may run before it's killed")
+        ->check(CLI::PositiveNumber);
+    test_cmd->add_option("--shard", test_options.shard,
+                         "Run only shard i of n (i/n), for splitting tests "
+                         "across CI machines");
+    test_cmd->add_flag("--failed", test_options.failed,
+                       "Only rerun the tests that failed last time");
 
     auto add_cmd =
         app.add_subcommand("add", "Adds a new dependency to a 🌧️++ project");
@@ -563,6 +7803,18 @@ int main(int argc, char **argv) {
 
     auto sync_cmd =
         app.add_subcommand("sync", "Sync/install project dependencies");
+    dependency::SyncOptions sync_options;
+    sync_cmd->add_option("-j,--jobs", sync_options.jobs,
+                         "Number of dependencies to fetch at once")
+        ->check(CLI::PositiveNumber);
+    std::string fetch_mode = "shallow";
+    sync_cmd->add_option("--fetch", fetch_mode,
+                         "How much git history to fetch: shallow, blobless "
+                         "or full")
+        ->check(CLI::IsMember({"shallow", "blobless", "full"}));
+    sync_cmd->add_flag("--update", sync_options.update,
+                       "Accept locked deps whose fetched contents no longer "
+                       "match dreamcpp.lock");
 
     new_cmd->callback([&]() {
         spdlog::info("[🏗️] Creating new project '{}'", project_name);
@@ -598,23 +7850,42 @@ int main(int argc, char **argv) {
     });
 
     build_cmd->callback([&]() {
-        build();
+        build_options.use_cache = !no_cache;
+        build_options.use_pch = !no_pch;
+        if (unity_opt->count() > 0)
+            build_options.unity = unity_size;
+        if (workers_opt->count() > 0)
+            build_options.workers = remote::split_list(workers.c_str());
+        if (!pgo && pgo_train.empty() &&
+            std::filesystem::exists(WORKSPACE_MANIFEST)) {
+            if (!workspace::build(build_options))
+                exit(1);
+            return;
+        }
+        // Profile-guided -O0 would be a lot of work for nothing
+        if ((pgo || !pgo_train.empty()) && profile_opt->count() == 0)
+            build_options.profile = "release";
+        auto built = pgo || !pgo_train.empty()
+                         ? pgo::run(build_options, pgo_train)
+                         : build(build_options);
+        if (!built.has_value()) {
+            exit(1);
+        }
     });
 
     run_cmd->callback([&]() {
-        build();
-        if (!std::filesystem::exists("dreamcpp.toml")) {
-            spdlog::error("[⚒️] ❌ This... isn't a 🌌++ project.");
+        auto runcmd = build(run_options);
+        if (!runcmd.has_value()) {
             exit(1);
         }
-        auto app_config = parse_config_file(
-            "dreamcpp.toml",
-            std::filesystem::current_path().filename().string());
-        if (!app_config.has_value())
+        spdlog::info("[⚒️] Running: {}", *runcmd);
+        process::run({*runcmd}, process::Output::Inherit);
+    });
+
+    test_cmd->callback([&]() {
+        if (!tests::run(test_options)) {
             exit(1);
-        auto runcmd = std::format("build/{}", app_config->name);
-        spdlog::info("[⚒️] Running: {}", runcmd);
-        system(runcmd.c_str());
+        }
     });
 
     add_cmd->callback([&]() {
@@ -624,11 +7895,144 @@ int main(int argc, char **argv) {
     });
 
     sync_cmd->callback([&]() {
-        if (!dependency::sync()) {
+        sync_options.fetch =
+            dependency::parse_fetch_mode(fetch_mode).value_or(
+                dependency::FetchMode::Shallow);
+        bool synced = std::filesystem::exists(WORKSPACE_MANIFEST)
+                          ? workspace::sync(sync_options)
+                          : dependency::sync(sync_options);
+        if (!synced) {
+            exit(1);
+        }
+    });
+
+    auto cache_cmd =
+        app.add_subcommand("cache", "Manage the shared compile cache");
+    auto cache_stats_cmd =
+        cache_cmd->add_subcommand("stats", "Show cache size and hit rate");
+    auto cache_trim_cmd = cache_cmd->add_subcommand(
+        "trim", "Evict least recently used objects");
+    std::string cache_max_size = "5G";
+    cache_trim_cmd->add_option("--max-size", cache_max_size,
+                               "Size to shrink the cache to (e.g. 500M, 5G)");
+    auto cache_clear_cmd =
+        cache_cmd->add_subcommand("clear", "Delete every cached object");
+
+    cache_stats_cmd->callback([&]() { cache::print_stats(); });
+
+    cache_trim_cmd->callback([&]() {
+        auto max_bytes = cache::parse_size(cache_max_size);
+        if (!max_bytes.has_value()) {
+            spdlog::error("[🗃️] ❌ Invalid size '{}'", cache_max_size);
+            exit(1);
+        }
+        cache::trim(*max_bytes);
+    });
+
+    cache_clear_cmd->callback([&]() { cache::clear(); });
+
+    auto index_cmd = app.add_subcommand("index", "Work with package indexes");
+    auto index_sparse_cmd = index_cmd->add_subcommand(
+        "sparse", "Split an index into the sparse, file per package layout");
+    std::string index_source;
+    std::string index_out_dir;
+    index_sparse_cmd->add_option("index", index_source, "Index to split")
+        ->required()
+        ->check(CLI::ExistingFile);
+    index_sparse_cmd->add_option("out_dir", index_out_dir,
+                                 "Directory to serve it from")
+        ->required();
+
+    index_sparse_cmd->callback([&]() {
+        if (!sparse_index::write(index_source, index_out_dir))
+            exit(1);
+    });
+
+    auto watch_cmd = app.add_subcommand(
+        "watch", "Rebuild a 🌙++ project whenever its sources change");
+    watch::Options watch_options;
+    watch_cmd->add_option("-j,--jobs", watch_options.build.jobs,
+                          "Number of compile jobs to run at once")
+        ->check(CLI::PositiveNumber);
+    watch_cmd->add_option("-p,--profile", watch_options.build.profile,
+                          "Build profile to build with");
+    watch_cmd->add_flag("--run", watch_options.run,
+                        "Restart the binary after every successful build");
+
+    watch_cmd->callback([&]() {
+        if (!watch::run(watch_options)) {
+            exit(1);
+        }
+    });
+
+    auto worker_cmd = app.add_subcommand(
+        "worker", "Compile jobs sent by other machines' builds");
+    remote::worker::Options worker_options;
+    worker_cmd->add_option("--listen", worker_options.listen,
+                           "unix:<path>, tcp:<host>:<port> or <host>:<port>");
+    worker_cmd->add_option("-j,--jobs", worker_options.jobs,
+                           "Number of compile jobs to run at once")
+        ->check(CLI::PositiveNumber);
+    std::string allowed_compilers;
+    auto allow_opt = worker_cmd->add_option(
+        "--allow", allowed_compilers,
+        "Comma-separated compilers clients may use (default: c++,g++,clang++)");
+
+    worker_cmd->callback([&]() {
+        if (allow_opt->count() > 0)
+            worker_options.compilers =
+                remote::split_list(allowed_compilers.c_str());
+        if (!remote::worker::run(worker_options)) {
             exit(1);
         }
     });
 
+    auto bench_cmd = app.add_subcommand(
+        "bench", "Time new/sync/build/run on a generated project");
+    bench::Options bench_options;
+    bench_cmd->add_option("--sources", bench_options.sources,
+                          "Number of source files to generate");
+    bench_cmd->add_option("--headers", bench_options.headers,
+                          "Number of project headers to generate")
+        ->check(CLI::PositiveNumber);
+    bench_cmd->add_option("--deps", bench_options.deps,
+                          "Number of header-only deps to generate");
+    bench_cmd->add_option("--repeat", bench_options.repeat,
+                          "How many times to run each scenario")
+        ->check(CLI::PositiveNumber);
+    bench_cmd->add_option("--compiler", bench_options.compiler,
+                          "Compiler the generated project uses");
+    bench_cmd->add_option("--linker", bench_options.linker,
+                          "Linker the generated project uses (mold, lld...)");
+    bench_cmd->add_option("--dir", bench_options.dir,
+                          "Work dir to generate into (must not exist)");
+    bench_cmd->add_option("-o,--output", bench_options.output,
+                          "Where to write the JSON results");
+    bench_cmd->add_flag("--keep", bench_options.keep,
+                        "Keep the work dir afterwards");
+
+    bench_cmd->callback([&]() {
+        if (!bench::run(bench_options)) {
+            exit(1);
+        }
+    });
+
+    // Runs before any subcommand callback
+    app.parse_complete_callback([&]() {
+        if (verbose)
+            spdlog::set_level(spdlog::level::debug);
+        if (verbose || !trace_path.empty()) {
+            trace::recording = true;
+            // Subcommands exit() on failure, and those runs need tracing most
+            std::atexit([]() {
+                trace::recording = false;
+                trace::print_summary();
+                if (!trace_path.empty())
+                    trace::write_chrome_trace(trace_path);
+            });
+        }
+    });
+
     try {
         app.parse(argc, argv);
     } catch (const CLI::ParseError &e) {
@@ -0,0 +1,85 @@
+// Everything lives in src/main.cpp, so tests pull it in with its main()
+// renamed out of the way
+#define main dreamcpp_main
+#include "main.cpp"
+#undef main
+
+using time_report::Json;
+using time_report::JsonParser;
+
+int failures = 0;
+
+void check(bool ok, std::string_view what) {
+    if (ok)
+        return;
+    std::fprintf(stderr, "failed: %.*s\n", (int)what.size(), what.data());
+    ++failures;
+}
+
+int main() {
+    // The shape of what clang's -ftime-trace writes
+    auto trace = JsonParser(R"({
+        "traceEvents": [
+            {"name": "Source", "ph": "X", "ts": 10, "dur": 2.5e3,
+             "args": {"detail": "/usr/include/c++/vector"}},
+            {"name": "Total Frontend", "dur": -1, "args": {}}
+        ],
+        "beginningOfTime": 1700000000000000,
+        "flag": true, "other": false, "nothing": null
+    })").parse();
+    check(trace.has_value(), "a trace parses");
+    if (trace.has_value()) {
+        check(trace->type == Json::Type::Object, "the root is an object");
+        auto *events = trace->get("traceEvents");
+        check(events && events->type == Json::Type::Array &&
+                  events->items.size() == 2,
+              "traceEvents has both events");
+        if (events && events->items.size() == 2) {
+            const auto &event = events->items[0];
+            check(event.get("name") && event.get("name")->string == "Source",
+                  "strings");
+            check(event.get("dur") && event.get("dur")->number == 2500,
+                  "exponents");
+            auto *args = event.get("args");
+            check(args && args->get("detail") &&
+                      args->get("detail")->string == "/usr/include/c++/vector",
+                  "nested objects");
+            check(events->items[1].get("dur")->number == -1, "negatives");
+        }
+        check(trace->get("flag")->type == Json::Type::Bool &&
+                  trace->get("flag")->boolean,
+              "true");
+        check(trace->get("other")->type == Json::Type::Bool &&
+                  !trace->get("other")->boolean,
+              "false");
+        check(trace->get("nothing")->type == Json::Type::Null, "null");
+        check(trace->get("missing") == nullptr, "missing keys");
+    }
+
+    auto escapes =
+        JsonParser(R"(["a\"b\\c\/d", "\n\t", "\u00e9", "\ud83d\ude00"])").parse();
+    check(escapes.has_value() && escapes->items.size() == 4, "escapes parse");
+    if (escapes.has_value() && escapes->items.size() == 4) {
+        check(escapes->items[0].string == "a\"b\\c/d", "simple escapes");
+        check(escapes->items[1].string == "\n\t", "control escapes");
+        check(escapes->items[2].string == "\xc3\xa9", "\\u escapes");
+        check(escapes->items[3].string == "\xf0\x9f\x98\x80",
+              "surrogate pairs");
+    }
+
+    check(JsonParser("[]").parse().has_value(), "empty arrays");
+    check(JsonParser(" {} ").parse().has_value(), "surrounding space");
+    for (auto bad : {"", "{", "[1,]", "[1 2]", "{\"a\" 1}", "{\"a\":}",
+                     "{a: 1}", "\"open", "\"\\u12\"", "tru", "nul", "1 2",
+                     "{} x", "[\"a\"", "--1"}) {
+        check(!JsonParser(bad).parse().has_value(),
+              std::format("rejects '{}'", bad));
+    }
+
+    // Deep nesting is refused rather than recursing until the stack runs out
+    std::string deep = std::string(100, '[') + std::string(100, ']');
+    check(JsonParser(deep).parse().has_value(), "100 levels of nesting");
+    std::string too_deep = std::string(100000, '[') + std::string(100000, ']');
+    check(!JsonParser(too_deep).parse().has_value(), "100000 levels");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Everything lives in src/main.cpp, so tests pull it in with its main()
+// renamed out of the way
+#define main dreamcpp_main
+#include "main.cpp"
+#undef main
+
+namespace fs = std::filesystem;
+
+int failures = 0;
+fs::path scratch;
+
+modules::Info scan(const std::string &source) {
+    auto fp = scratch / "unit.cpp";
+    std::ofstream(fp) << source;
+    return modules::scan(fp.string());
+}
+
+void check(bool ok, std::string_view what) {
+    if (ok)
+        return;
+    std::fprintf(stderr, "failed: %.*s\n", (int)what.size(), what.data());
+    ++failures;
+}
+
+int main() {
+    scratch = fs::temp_directory_path() /
+              std::format("dreamcpp-test-modules-{}", getpid());
+    fs::create_directories(scratch);
+
+    auto interface = scan("module;\n"
+                          "#include <cstdio>\n"
+                          "export module app.core:io;\n"
+                          "import std;\n"
+                          "export import :detail;\n"
+                          "import <vector>;\n"
+                          "module :private;\n");
+    check(interface.provides == "app.core:io" && interface.interface,
+          "export module with a partition");
+    check(interface.imports ==
+              std::vector<std::string>{"std", "app.core:detail"},
+          "imports, partitions qualified");
+    check(interface.header_units.size() == 1, "header units");
+
+    auto implementation = scan("module app.core;\nimport  other [[x]];\n");
+    check(implementation.provides.empty() &&
+              implementation.imports ==
+                  std::vector<std::string>{"app.core", "other"},
+          "an implementation unit imports its interface");
+
+    // Plain C++ that just happens to use the words as names
+    auto plain = scan("int main() {\n"
+                      "    int module = 0, import = 1;\n"
+                      "    module = 3;\n"
+                      "    import = module + 1;\n"
+                      "    module += import;\n"
+                      "    import (module);\n"
+                      "    module_id = 2;\n"
+                      "    module[0] = 1;\n"
+                      "    module.value = 1;\n"
+                      "    module->value = 1;\n"
+                      "    import, module;\n"
+                      "    // import commented;\n"
+                      "}\n");
+    check(!plain.uses_modules() && plain.header_units.empty(),
+          "variables named module and import");
+
+    fs::remove_all(scratch);
+    return failures == 0 ? 0 : 1;
+}
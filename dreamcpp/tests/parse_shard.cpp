@@ -0,0 +1,37 @@
+// Everything lives in src/main.cpp, so tests pull it in with its main()
+// renamed out of the way
+#define main dreamcpp_main
+#include "main.cpp"
+#undef main
+
+int main() {
+    int failures = 0;
+    auto expect = [&](std::string_view text,
+                      std::optional<std::pair<unsigned, unsigned>> want) {
+        auto got = tests::parse_shard(text);
+        if (got == want)
+            return;
+        std::fprintf(stderr, "parse_shard(\"%.*s\") gave %s\n",
+                     (int)text.size(), text.data(),
+                     got ? std::format("{}/{}", got->first, got->second).c_str()
+                         : "nothing");
+        ++failures;
+    };
+
+    expect("1/1", std::pair(1u, 1u));
+    expect("2/3", std::pair(2u, 3u));
+    expect("3/3", std::pair(3u, 3u));
+    expect("10/12", std::pair(10u, 12u));
+
+    // Shards count from 1 and can't go past the count
+    expect("0/3", std::nullopt);
+    expect("4/3", std::nullopt);
+    expect("1/0", std::nullopt);
+
+    for (auto bad : {"", "1", "/3", "1/", "/", "a/3", "1/b", "1/3x", " 1/3",
+                     "1 /3", "-1/3", "1/-3", "+1/3", "1/3/4", "1.0/3",
+                     "99999999999/99999999999"}) {
+        expect(bad, std::nullopt);
+    }
+    return failures == 0 ? 0 : 1;
+}
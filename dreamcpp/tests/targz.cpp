@@ -0,0 +1,134 @@
+// Everything lives in src/main.cpp, so tests pull it in with its main()
+// renamed out of the way
+#define main dreamcpp_main
+#include "main.cpp"
+#undef main
+
+namespace fs = std::filesystem;
+
+struct Entry {
+    std::string name;
+    char type = '0';
+    std::string data; // File contents, or the link target
+};
+
+// A ustar header, just the fields TarGz reads
+std::string header(const Entry &entry, size_t size) {
+    std::string h(512, '\0');
+    auto put = [&](size_t at, std::string_view value) {
+        h.replace(at, value.size(), value);
+    };
+    put(0, entry.name);
+    put(100, "0000644");
+    put(124, std::format("{:011o}", size));
+    h[156] = entry.type;
+    if (entry.type == '1' || entry.type == '2')
+        put(157, entry.data);
+    put(257, "ustar");
+    put(263, "00");
+    put(148, "        ");
+    unsigned sum = 0;
+    for (unsigned char c : h)
+        sum += c;
+    put(148, std::format("{:06o}", sum));
+    h[154] = '\0';
+    return h;
+}
+
+std::string tar_gz(const std::vector<Entry> &entries) {
+    std::string tar;
+    for (const auto &entry : entries) {
+        bool has_data = entry.type == '0';
+        size_t size = has_data ? entry.data.size() : 0;
+        tar += header(entry, size);
+        if (has_data) {
+            tar += entry.data;
+            tar.append((512 - size % 512) % 512, '\0');
+        }
+    }
+    tar.append(1024, '\0');
+
+    uLongf length = compressBound(tar.size());
+    std::string out(length, '\0');
+    compress2((Bytef *)out.data(), &length, (const Bytef *)tar.data(),
+              tar.size(), Z_BEST_SPEED);
+    out.resize(length);
+    return out;
+}
+
+int failures = 0;
+fs::path scratch;
+
+// Extracts into a fresh <scratch>/root, true if TarGz accepted it all
+bool extract(const std::vector<Entry> &entries) {
+    fs::remove_all(scratch);
+    fs::create_directories(scratch / "root");
+    auto data = tar_gz(entries);
+    archive::TarGz tar(scratch / "root", 0);
+    return tar.feed(data.data(), data.size()) && tar.finish();
+}
+
+void check(bool ok, std::string_view what) {
+    if (ok)
+        return;
+    std::fprintf(stderr, "failed: %.*s\n", (int)what.size(), what.data());
+    ++failures;
+}
+
+// Nothing may ever appear next to the root
+bool contained() {
+    for (const auto &entry : fs::directory_iterator(scratch)) {
+        if (entry.path().filename() != "root")
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    scratch = fs::temp_directory_path() /
+              std::format("dreamcpp-test-targz-{}", getpid());
+
+    check(extract({{"dir", '5', ""},
+                   {"dir/file.txt", '0', "hello"},
+                   {"dir/link", '2', "file.txt"},
+                   {"dir/hard", '1', "dir/file.txt"}}),
+          "a plain archive extracts");
+    std::ifstream file(scratch / "root" / "dir" / "hard");
+    std::string text;
+    std::getline(file, text);
+    check(text == "hello", "hardlinks are copied");
+
+    check(!extract({{"../evil", '0', "x"}}) && contained(),
+          "'..' is refused");
+    check(!extract({{"dir/../../evil", '0', "x"}}) && contained(),
+          "'..' after a dir is refused");
+    check(!extract({{"/tmp/dreamcpp-evil", '0', "x"}}) &&
+              !fs::exists("/tmp/dreamcpp-evil"),
+          "absolute paths are refused");
+    check(!extract({{"up", '2', ".."}}), "symlinks out are refused");
+    check(!extract({{"up", '2', "/etc"}}), "absolute symlinks are refused");
+    check(!extract({{"f", '1', "../outside"}}), "hardlinks out are refused");
+
+    // Each link stays inside on its own, only together do they reach out
+    check(!extract({{"a", '5', ""},
+                    {"a/b", '2', ".."},
+                    {"a/b/c", '2', ".."},
+                    {"a/b/c/evil", '0', "x"}}) &&
+              contained(),
+          "chained symlinks are refused");
+    check(!extract({{"a", '2', "."}, {"a/evil", '0', "x"}}),
+          "writing through a symlinked dir is refused");
+
+    // A later file replaces the link rather than writing to its target
+    check(extract({{"target", '0', "keep"},
+                   {"link", '2', "target"},
+                   {"link", '0', "new"}}),
+          "a file over a link extracts");
+    std::ifstream target(scratch / "root" / "target");
+    std::getline(target, text);
+    check(text == "keep" && !fs::is_symlink(scratch / "root" / "link"),
+          "a file over a link replaces the link");
+
+    fs::remove_all(scratch);
+    return failures == 0 ? 0 : 1;
+}